@@ -26,7 +26,7 @@
 #include "qryptonightpool.h"
 #include "misc/bignum.h"
 
-std::shared_ptr<QryptonightPool> PoWHelper::_qnpool = std::make_shared<QryptonightPool>();
+std::shared_ptr<QryptonightPool> PoWHelper::_qnpool = QryptonightPool::hashers();
 
 PoWHelper::PoWHelper(int64_t kp,
                      uint64_t set_point,
@@ -97,13 +97,18 @@ std::vector<uint8_t> PoWHelper::getTarget(const std::vector<uint8_t> &difficulty
 
 bool PoWHelper::passesTarget(const std::vector<uint8_t> &hash, const std::vector<uint8_t> &target)
 {
-    // The hash needs to be below or equals to the target (both 32 bytes)
-    // Monero uses little endian.. we need to check in reverse order
     if (hash.size()!=32 || target.size()!=32)
     {
         return false;
     }
 
+    return passesTarget(hash.data(), target.data());
+}
+
+bool PoWHelper::passesTarget(const uint8_t *hash, const uint8_t *target)
+{
+    // The hash needs to be below or equals to the target (both 32 bytes)
+    // Monero uses little endian.. we need to check in reverse order
     for(size_t i = 0; i < 32; i++)
     {
         const uint8_t h = hash[31-i];
@@ -120,7 +125,14 @@ bool PoWHelper::passesTarget(const std::vector<uint8_t> &hash, const std::vector
 
 bool PoWHelper::verifyInput(const std::vector<uint8_t> &input, const std::vector<uint8_t> &target)
 {
+    // a malformed target cannot pass, do not take a hasher from the budget for it
+    if (target.size()!=32)
+    {
+        return false;
+    }
+
+    std::array<uint8_t, 32> hash;
     auto qn = _qnpool->acquire();
-    auto hash = qn->hash(input);
-    return passesTarget(hash, target);
+    qn->hash(input.data(), input.size(), hash);
+    return passesTarget(hash.data(), target.data());
 }
@@ -49,6 +49,10 @@ public:
     std::vector<uint8_t> getTarget(const std::vector<uint8_t> &difficulty);
 
     static bool passesTarget(const std::vector<uint8_t> &hash, const std::vector<uint8_t> &target);
+#ifndef SWIG
+    // Both buffers must hold 32 bytes
+    static bool passesTarget(const uint8_t *hash, const uint8_t *target);
+#endif
     bool verifyInput(const std::vector<uint8_t> &input, const std::vector<uint8_t> &target);
 
 private:
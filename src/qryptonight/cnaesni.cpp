@@ -0,0 +1,34 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#if (defined(__linux__) || defined(__APPLE__)) && (defined(__x86_64__) || defined(_M_X64))
+
+// This file is compiled with AES-NI enabled (see CMakeLists.txt). It must only
+// run after CnBackendRegistry has checked the CPU supports it
+
+#include "cnaesniimpl.h"
+#include "cnbackend.h"
+
+const CnKernels cn_kernels_aesni = cn_kernels<AesNiKernel>();
+
+#endif
@@ -0,0 +1,181 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#ifndef QRYPTONIGHT_CNAESNIIMPL_H
+#define QRYPTONIGHT_CNAESNIIMPL_H
+
+// Only include this from backend translation units compiled with AES-NI
+// enabled (see CMakeLists.txt)
+
+#include <immintrin.h>
+#include "cnkernelimpl.h"
+
+namespace {
+
+// AES-NI backend. The VAES backends reuse its main loop
+struct AesNiKernel : LaneKernel<AesNiKernel>
+{
+    template<class Algo>
+    static void explode(const uint8_t *state, uint8_t *long_state)
+    {
+        uint32_t round_keys[40];
+        aes_expand_key(state, round_keys);
+
+        __m128i k[10];
+        for (int i = 0; i < 10; i++)
+        {
+            k[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(round_keys) + i);
+        }
+
+        __m128i x[8];
+        for (int j = 0; j < 8; j++)
+        {
+            x[j] = _mm_load_si128(reinterpret_cast<const __m128i *>(state + 64) + j);
+        }
+
+        auto out = reinterpret_cast<__m128i *>(long_state);
+        for (size_t i = 0; i < Algo::memory / 16; i += 8)
+        {
+            for (int r = 0; r < 10; r++)
+            {
+                for (int j = 0; j < 8; j++)
+                {
+                    x[j] = _mm_aesenc_si128(x[j], k[r]);
+                }
+            }
+            for (int j = 0; j < 8; j++)
+            {
+                _mm_store_si128(out + i + j, x[j]);
+            }
+        }
+    }
+
+    template<class Algo>
+    static void implode(const uint8_t *long_state, uint8_t *state)
+    {
+        uint32_t round_keys[40];
+        aes_expand_key(state + 32, round_keys);
+
+        __m128i k[10];
+        for (int i = 0; i < 10; i++)
+        {
+            k[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(round_keys) + i);
+        }
+
+        __m128i x[8];
+        for (int j = 0; j < 8; j++)
+        {
+            x[j] = _mm_load_si128(reinterpret_cast<const __m128i *>(state + 64) + j);
+        }
+
+        auto in = reinterpret_cast<const __m128i *>(long_state);
+        for (size_t i = 0; i < Algo::memory / 16; i += 8)
+        {
+            for (int j = 0; j < 8; j++)
+            {
+                x[j] = _mm_xor_si128(x[j], _mm_load_si128(in + i + j));
+            }
+            for (int r = 0; r < 10; r++)
+            {
+                for (int j = 0; j < 8; j++)
+                {
+                    x[j] = _mm_aesenc_si128(x[j], k[r]);
+                }
+            }
+        }
+
+        for (int j = 0; j < 8; j++)
+        {
+            _mm_store_si128(reinterpret_cast<__m128i *>(state + 64) + j, x[j]);
+        }
+    }
+
+    template<class Algo, size_t N>
+    static void main_loop(cn_context **ctx, const uint64_t *tweak)
+    {
+        uint8_t *l[N];
+        uint64_t al[N];
+        uint64_t ah[N];
+        __m128i bx[N];
+
+        for (size_t n = 0; n < N; n++)
+        {
+            const uint8_t *state = ctx[n]->hash_state;
+            l[n] = ctx[n]->long_state;
+            al[n] = load64(state) ^ load64(state + 32);
+            ah[n] = load64(state + 8) ^ load64(state + 40);
+            bx[n] = _mm_xor_si128(_mm_load_si128(reinterpret_cast<const __m128i *>(state) + 1),
+                                  _mm_load_si128(reinterpret_cast<const __m128i *>(state) + 3));
+        }
+
+        for (size_t i = 0; i < Algo::iterations; i++)
+        {
+            uint64_t idx[N];
+
+            for (size_t n = 0; n < N; n++)
+            {
+                auto p = reinterpret_cast<__m128i *>(l[n] + (al[n] & Algo::mask));
+                __m128i cx = _mm_load_si128(p);
+                cx = _mm_aesenc_si128(cx, _mm_set_epi64x(static_cast<int64_t>(ah[n]), static_cast<int64_t>(al[n])));
+
+                const __m128i v = _mm_xor_si128(bx[n], cx);
+                auto q = reinterpret_cast<uint64_t *>(p);
+                q[0] = static_cast<uint64_t>(_mm_cvtsi128_si64(v));
+                q[1] = static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v)));
+                if constexpr (Algo::variant == 1)
+                {
+                    q[1] = variant1_tweak(q[1]);
+                }
+
+                idx[n] = static_cast<uint64_t>(_mm_cvtsi128_si64(cx));
+                bx[n] = cx;
+            }
+
+            for (size_t n = 0; n < N; n++)
+            {
+                auto q = reinterpret_cast<uint64_t *>(l[n] + (idx[n] & Algo::mask));
+                const uint64_t cl = q[0];
+                const uint64_t ch = q[1];
+
+                uint64_t hi;
+                const uint64_t lo = mul128(idx[n], cl, &hi);
+                al[n] += hi;
+                ah[n] += lo;
+
+                q[0] = al[n];
+                q[1] = ah[n];
+                if constexpr (Algo::variant == 1)
+                {
+                    q[1] ^= tweak[n];
+                }
+
+                al[n] ^= cl;
+                ah[n] ^= ch;
+            }
+        }
+    }
+};
+
+}
+
+#endif //QRYPTONIGHT_CNAESNIIMPL_H
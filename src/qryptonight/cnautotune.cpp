@@ -0,0 +1,336 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include "cnautotune.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// setup.py passes the package version, CMake the git revision. A build
+// without either is told apart by when this file was compiled
+#if defined(VERSION_INFO)
+#define QRYPTONIGHT_TUNE_BUILD VERSION_INFO
+#elif defined(QRYPTONIGHT_BUILD_ID)
+#define QRYPTONIGHT_TUNE_BUILD QRYPTONIGHT_BUILD_ID
+#else
+#define QRYPTONIGHT_TUNE_BUILD __DATE__ " " __TIME__
+#endif
+
+namespace {
+    // time spent measuring each backend and interleave factor
+    const double min_seconds_per_candidate = 0.1;
+
+    class Contexts
+    {
+    public:
+        Contexts()
+        {
+            std::string error;
+            for (auto &ctx : _contexts)
+            {
+                ctx = cn_alloc_context(error);
+                _valid = _valid && ctx != nullptr;
+            }
+        }
+
+        ~Contexts()
+        {
+            for (auto ctx : _contexts)
+            {
+                cn_free_context(ctx);
+            }
+        }
+
+        bool isValid() const { return _valid; }
+        cn_context **get() { return _contexts; }
+
+    protected:
+        cn_context *_contexts[CN_MAX_WAYS] = {};
+        bool _valid = true;
+    };
+
+    std::string sanitize(std::string value)
+    {
+        std::replace(value.begin(), value.end(), '\t', ' ');
+        std::replace(value.begin(), value.end(), '\n', ' ');
+        return value;
+    }
+
+    void makeParentDirs(const std::string &path)
+    {
+        for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1))
+        {
+            mkdir(path.substr(0, pos).c_str(), 0755);
+        }
+    }
+}
+
+const std::vector<CnKnownAnswer> &CnAutotune::knownAnswers()
+{
+    static const std::vector<CnKnownAnswer> vectors = []() {
+        std::vector<CnKnownAnswer> result(2);
+
+        for (size_t i = 0; i < 64; i += 4)
+        {
+            result[0].input.insert(result[0].input.end(), {0x03, 0x05, 0x07, 0x09});
+        }
+        result[0].output = {
+            0xd7, 0xf6, 0x86, 0xcc, 0xdf, 0xb4, 0xe8, 0x59,
+            0xe1, 0x62, 0xf9, 0x6d, 0xdd, 0x6a, 0x3b, 0x75,
+            0x79, 0xf2, 0x00, 0xf2, 0xf0, 0xe4, 0x26, 0xae,
+            0x14, 0x32, 0x74, 0xbe, 0x06, 0x1a, 0x8c, 0xf0
+        };
+
+        result[1].input.resize(10000);
+        result[1].output = {
+            0xbf, 0x2f, 0xa0, 0x5d, 0x59, 0x67, 0x60, 0xa8,
+            0x43, 0x19, 0xd9, 0xe8, 0x97, 0x5e, 0x80, 0xcc,
+            0xa6, 0x70, 0xdd, 0x9e, 0x19, 0xc8, 0x37, 0x3d,
+            0xc9, 0x05, 0x49, 0xf2, 0xd3, 0x09, 0x5e, 0x0c
+        };
+
+        return result;
+    }();
+
+    return vectors;
+}
+
+bool CnAutotune::selfTest(const CnBackend &backend, const std::vector<CnKnownAnswer> &vectors)
+{
+    Contexts ctx;
+    if (!ctx.isValid())
+    {
+        return false;
+    }
+
+    const auto hash = backend.kernels[CN_ALGO_QRL];
+
+    for (const auto &vector : vectors)
+    {
+        uint8_t output[32];
+        hash(vector.input.data(), vector.input.size(), output, ctx.get(), 1);
+        if (!std::equal(vector.output.begin(), vector.output.end(), output))
+        {
+            return false;
+        }
+    }
+
+    // every interleaved lane has to agree as well
+    if (!vectors.empty())
+    {
+        const auto &vector = vectors.front();
+        const size_t len = vector.input.size();
+
+        std::vector<uint8_t> input(len * CN_MAX_WAYS);
+        std::vector<uint8_t> output(32 * CN_MAX_WAYS);
+        for (size_t n = 0; n < CN_MAX_WAYS; n++)
+        {
+            std::copy(vector.input.begin(), vector.input.end(), input.begin() + n * len);
+        }
+
+        hash(input.data(), len, output.data(), ctx.get(), CN_MAX_WAYS);
+        for (size_t n = 0; n < CN_MAX_WAYS; n++)
+        {
+            if (!std::equal(vector.output.begin(), vector.output.end(), output.begin() + n * 32))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+CnTuneResult CnAutotune::tune(const std::vector<CnKnownAnswer> &vectors)
+{
+    CnTuneResult best;
+
+    Contexts ctx;
+    if (!ctx.isValid())
+    {
+        return best;
+    }
+
+    auto &registry = CnBackendRegistry::instance();
+    std::vector<uint8_t> input(76 * CN_MAX_WAYS, 0x5a);
+    std::vector<uint8_t> output(32 * CN_MAX_WAYS);
+
+    for (const auto &name : registry.available())
+    {
+        auto backend = registry.find(name);
+        if (backend == nullptr || !selfTest(*backend, vectors))
+        {
+            continue;
+        }
+
+        for (uint32_t ways = 1; ways <= CN_MAX_WAYS; ways++)
+        {
+            size_t hashes = 0;
+            double elapsed = 0;
+
+            const auto start = std::chrono::steady_clock::now();
+            do
+            {
+                backend->kernels[CN_ALGO_QRL](input.data(), 76, output.data(), ctx.get(), ways);
+                hashes += ways;
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            } while (elapsed < min_seconds_per_candidate);
+
+            const double rate = hashes / elapsed;
+            if (rate > best.hashesPerSecond)
+            {
+                best.backend = name;
+                best.ways = ways;
+                best.hashesPerSecond = rate;
+            }
+        }
+    }
+
+    return best;
+}
+
+CnTuneResult CnAutotune::cachedOrTune()
+{
+    const auto path = cachePath();
+    const auto key = cacheKey();
+
+    // the cached backend still has to reproduce the known answers
+    CnTuneResult result;
+    if (!path.empty() && loadCached(path, key, result))
+    {
+        auto backend = CnBackendRegistry::instance().find(result.backend);
+        if (backend != nullptr && selfTest(*backend, knownAnswers()))
+        {
+            return result;
+        }
+    }
+
+    result = tune();
+    if (!path.empty() && !result.backend.empty())
+    {
+        storeCached(path, key, result);
+    }
+    return result;
+}
+
+bool CnAutotune::enabled()
+{
+    const char *setting = std::getenv("QRYPTONIGHT_AUTOTUNE");
+    return setting != nullptr && std::string(setting) != "0";
+}
+
+std::string CnAutotune::cacheKey()
+{
+    std::string key = getCpuBrand() + "|" + QRYPTONIGHT_TUNE_BUILD + "|";
+    for (const auto &name : CnBackendRegistry::instance().names())
+    {
+        key += name + ",";
+    }
+    return sanitize(key);
+}
+
+std::string CnAutotune::cachePath()
+{
+    if (const char *path = std::getenv("QRYPTONIGHT_TUNE_CACHE"))
+    {
+        return path;
+    }
+    if (const char *cache = std::getenv("XDG_CACHE_HOME"))
+    {
+        return std::string(cache) + "/qryptonight/autotune";
+    }
+    if (const char *home = std::getenv("HOME"))
+    {
+        return std::string(home) + "/.cache/qryptonight/autotune";
+    }
+    return "";
+}
+
+// One line per host: key, backend, interleave factor and hashes per second,
+// separated by tabs. Several hosts can share the file (e.g. an NFS home)
+bool CnAutotune::loadCached(const std::string &path, const std::string &key, CnTuneResult &result)
+{
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string line_key;
+        CnTuneResult cached;
+        if (std::getline(fields, line_key, '\t') && line_key == key &&
+            std::getline(fields, cached.backend, '\t') &&
+            fields >> cached.ways >> cached.hashesPerSecond &&
+            cached.ways >= 1 && cached.ways <= CN_MAX_WAYS)
+        {
+            result = cached;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CnAutotune::storeCached(const std::string &path, const std::string &key, const CnTuneResult &result)
+{
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.compare(0, key.size() + 1, key + "\t") != 0)
+            {
+                lines.push_back(line);
+            }
+        }
+    }
+
+    std::ostringstream entry;
+    entry << key << '\t' << sanitize(result.backend) << '\t' << result.ways << '\t' << result.hashesPerSecond;
+    lines.push_back(entry.str());
+
+    // write a private copy and rename it over, so readers never see a partial file
+    makeParentDirs(path);
+    const std::string tmp_path = path + "." + std::to_string(getpid());
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        for (const auto &line : lines)
+        {
+            file << line << '\n';
+        }
+        if (!file)
+        {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#ifndef QRYPTONIGHT_CNAUTOTUNE_H
+#define QRYPTONIGHT_CNAUTOTUNE_H
+
+#include "cnbackend.h"
+#include <string>
+#include <vector>
+
+struct CnKnownAnswer
+{
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> output;
+};
+
+struct CnTuneResult
+{
+    std::string backend;        // empty if no backend passed the self-test
+    uint32_t ways = 1;          // fastest interleave factor for that backend
+    double hashesPerSecond = 0; // single thread, at that interleave factor
+};
+
+// Picks the backend for this host by measurement. Every available backend
+// must first reproduce the known-answer vectors, single and interleaved; the
+// fastest of the ones that pass wins. The result is cached in a file keyed by
+// CPU model, library build and the backends built in, so later processes
+// skip the tuning. Tuning takes a few seconds, so the first hash only waits
+// for it with QRYPTONIGHT_AUTOTUNE=1; otherwise the static ranking applies
+// until Qryptonight::autotune() is called
+class CnAutotune
+{
+public:
+    // QRL hashes, the same ones tests/cpp/qryptonight.cpp checks
+    static const std::vector<CnKnownAnswer> &knownAnswers();
+
+    static bool selfTest(const CnBackend &backend, const std::vector<CnKnownAnswer> &vectors);
+
+    static CnTuneResult tune(const std::vector<CnKnownAnswer> &vectors = knownAnswers());
+
+    // cached result if there is one and its backend still passes the
+    // self-test, otherwise tune() and store it
+    static CnTuneResult cachedOrTune();
+
+    // true if QRYPTONIGHT_AUTOTUNE is set and not 0
+    static bool enabled();
+
+    static std::string cacheKey();
+
+    // $QRYPTONIGHT_TUNE_CACHE, $XDG_CACHE_HOME/qryptonight/autotune or
+    // $HOME/.cache/qryptonight/autotune. Empty if none of them is set
+    static std::string cachePath();
+
+    static bool loadCached(const std::string &path, const std::string &key, CnTuneResult &result);
+    static bool storeCached(const std::string &path, const std::string &key, const CnTuneResult &result);
+};
+
+#endif //QRYPTONIGHT_CNAUTOTUNE_H
@@ -0,0 +1,178 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include "cnbackend.h"
+#include "cnautotune.h"
+#include <algorithm>
+#include <cstdlib>
+
+CnBackendRegistry &CnBackendRegistry::instance()
+{
+    static CnBackendRegistry registry;
+    return registry;
+}
+
+CnBackendRegistry::CnBackendRegistry()
+{
+    add({"soft", [](const CpuFeatures &) { return true; }, cn_kernels_soft, 0});
+    // ahead of soft, outside x86-64 it is the only one using hardware AES
+    add({"reference", [](const CpuFeatures &) { return true; }, cn_kernels_reference, 5});
+#if defined(__x86_64__) || defined(_M_X64)
+    add({"aesni", [](const CpuFeatures &f) { return f.sse2 && f.aes; }, cn_kernels_aesni, 10});
+#if defined(QRYPTONIGHT_HAVE_VAES)
+    add({"vaes256", [](const CpuFeatures &f) { return f.aes && f.avx2 && f.vaes; }, cn_kernels_vaes256, 20});
+    add({"vaes512", [](const CpuFeatures &f) { return f.aes && f.avx512f && f.vaes; }, cn_kernels_vaes512, 30});
+#endif
+#endif
+}
+
+void CnBackendRegistry::add(const CnBackend &backend)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _backends.emplace_back(new CnBackend(backend));
+
+    // keep the list sorted best first
+    std::stable_sort(_backends.begin(), _backends.end(),
+                     [](const std::unique_ptr<CnBackend> &a, const std::unique_ptr<CnBackend> &b)
+                     { return a->priority > b->priority; });
+}
+
+std::vector<std::string> CnBackendRegistry::names() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<std::string> result;
+    for (const auto &backend : _backends)
+    {
+        result.push_back(backend->name);
+    }
+    return result;
+}
+
+std::vector<std::string> CnBackendRegistry::available() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<std::string> result;
+    for (const auto &backend : _backends)
+    {
+        if (backend->supported(getCpuFeatures()))
+        {
+            result.push_back(backend->name);
+        }
+    }
+    return result;
+}
+
+const CnBackend *CnBackendRegistry::find(const std::string &name) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto &backend : _backends)
+    {
+        if (backend->name == name && backend->supported(getCpuFeatures()))
+        {
+            return backend.get();
+        }
+    }
+    return nullptr;
+}
+
+bool CnBackendRegistry::select(const std::string &name)
+{
+    return selectTuned(name, 0);
+}
+
+bool CnBackendRegistry::selectTuned(const std::string &name, uint32_t ways)
+{
+    auto backend = find(name);
+    if (backend == nullptr)
+    {
+        return false;
+    }
+
+    // the ways always belong to the active backend
+    std::lock_guard<std::mutex> lock(_mutex);
+    _active = backend;
+    _tuned_ways = ways;
+    return true;
+}
+
+const CnBackend &CnBackendRegistry::active()
+{
+    auto backend = _active.load(std::memory_order_acquire);
+    if (backend == nullptr)
+    {
+        // the autotune may take a moment, make sure it runs only once
+        std::call_once(_default_once, [this]() {
+            uint32_t tuned_ways = 0;
+            auto chosen = defaultBackend(tuned_ways);
+
+            // keep a backend selected concurrently, along with its ways
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_active.load() == nullptr)
+            {
+                _active = chosen;
+                _tuned_ways = tuned_ways;
+            }
+        });
+        backend = _active.load(std::memory_order_acquire);
+    }
+    return *backend;
+}
+
+const CnBackend *CnBackendRegistry::defaultBackend(uint32_t &tuned_ways)
+{
+    const char *forced = std::getenv("QRYPTONIGHT_BACKEND");
+    if (forced != nullptr)
+    {
+        auto backend = find(forced);
+        if (backend != nullptr)
+        {
+            return backend;
+        }
+    }
+
+    if (CnAutotune::enabled())
+    {
+        const auto tuned = CnAutotune::cachedOrTune();
+        auto backend = find(tuned.backend);
+        if (backend != nullptr)
+        {
+            tuned_ways = tuned.ways;
+            return backend;
+        }
+    }
+
+    // soft is always supported, so this never ends up empty
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto &backend : _backends)
+    {
+        if (backend->supported(getCpuFeatures()))
+        {
+            return backend.get();
+        }
+    }
+    return nullptr;
+}
+
+#endif
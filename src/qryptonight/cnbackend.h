@@ -0,0 +1,133 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#ifndef QRYPTONIGHT_CNBACKEND_H
+#define QRYPTONIGHT_CNBACKEND_H
+
+#include "cnkernel.h"
+#include "cpufeatures.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Algorithms every backend is built for. Hashing only uses CN_ALGO_QRL,
+// the others let the unit tests check the kernels cheaply (CN_ALGO_TEST)
+// and check the variant handling against the reference (CN_ALGO_V0)
+enum CnAlgoId
+{
+    CN_ALGO_QRL,
+    CN_ALGO_TEST,
+    CN_ALGO_V0,
+    CN_ALGO_COUNT
+};
+
+typedef CnAlgo<1, 1 << 16, 1 << 12> CnTestAlgo;
+typedef CnAlgo<0, CN_MEMORY, CN_ITERATIONS> CnV0Algo;
+
+// Entry point of a hash backend, same contract as cn_hash_ways()
+typedef void (*cn_hash_ways_fn)(const uint8_t *input, size_t len, uint8_t *output, cn_context **ctx, size_t ways);
+
+// Entry points of a backend, indexed by CnAlgoId
+typedef std::array<cn_hash_ways_fn, CN_ALGO_COUNT> CnKernels;
+
+// Built-in backends, each in its own translation unit with its own ISA flags
+extern const CnKernels cn_kernels_soft;
+extern const CnKernels cn_kernels_reference;
+#if defined(__x86_64__) || defined(_M_X64)
+extern const CnKernels cn_kernels_aesni;
+#if defined(QRYPTONIGHT_HAVE_VAES)
+extern const CnKernels cn_kernels_vaes256;
+extern const CnKernels cn_kernels_vaes512;
+#endif
+#endif
+
+struct CnBackend
+{
+    std::string name;
+
+    // true if the backend can run on a CPU with these features
+    bool (*supported)(const CpuFeatures &features);
+
+    CnKernels kernels;
+
+    // among the supported backends the one with the highest priority is used
+    uint32_t priority;
+};
+
+// Registry of the CryptoNight implementations linked into the library.
+// The active backend is chosen on first use: the QRYPTONIGHT_BACKEND
+// environment variable wins, then the autotune result if QRYPTONIGHT_AUTOTUNE
+// is set (see cnautotune.h),
+// then the supported backend with the highest priority. select() overrides
+// the choice at any time
+class CnBackendRegistry
+{
+public:
+    static CnBackendRegistry &instance();
+
+    // register an additional backend
+    void add(const CnBackend &backend);
+
+    // all registered backends
+    std::vector<std::string> names() const;
+
+    // backends that can run on this host, best first
+    std::vector<std::string> available() const;
+
+    // nullptr if the backend is unknown or cannot run on this host
+    const CnBackend *find(const std::string &name) const;
+
+    // force a backend for all hashing; false if it is not available
+    bool select(const std::string &name);
+
+    const CnBackend &active();
+
+    // select a backend along with the interleave factor the autotune
+    // measured fastest for it
+    bool selectTuned(const std::string &name, uint32_t ways);
+
+    // 0 if the autotune did not pick the active backend
+    uint32_t tunedWays() const { return _tuned_ways; }
+
+protected:
+    CnBackendRegistry();
+
+    // the backend to use when none was selected, and the interleave factor
+    // the autotune measured for it (0 if it did not pick it)
+    const CnBackend *defaultBackend(uint32_t &tuned_ways);
+
+    // guards _backends, and _active together with _tuned_ways when they change
+    mutable std::mutex _mutex;
+
+    // backends are never removed, so pointers to them stay valid
+    std::vector<std::unique_ptr<CnBackend>> _backends;
+
+    std::atomic<const CnBackend *> _active{nullptr};
+    std::atomic<uint32_t> _tuned_ways{0};
+    std::once_flag _default_once;
+};
+
+#endif //QRYPTONIGHT_CNBACKEND_H
@@ -0,0 +1,84 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include "cnkeccak.h"
+#include "cpufeatures.h"
+#include <algorithm>
+
+extern "C" {
+#include "keccak.h"
+}
+
+namespace {
+    bool useAvx2()
+    {
+#if defined(__x86_64__) || defined(_M_X64)
+        static const bool avx2 = getCpuFeatures().avx2;
+        return avx2;
+#else
+        return false;
+#endif
+    }
+}
+
+void cn_keccak1600_batch(const uint8_t *input, size_t len, cn_context **ctx, size_t count)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    if (count > 1 && useAvx2())
+    {
+        for (size_t first = 0; first < count; first += 4)
+        {
+            cn_keccak1600_x4_avx2(input + first * len, len, ctx + first, std::min<size_t>(4, count - first));
+        }
+        return;
+    }
+#endif
+
+    for (size_t n = 0; n < count; n++)
+    {
+        keccak1600(input + n * len, len, ctx[n]->hash_state);
+    }
+}
+
+void cn_keccakf_batch(cn_context **ctx, size_t count)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    if (count > 1 && useAvx2())
+    {
+        for (size_t first = 0; first < count; first += 4)
+        {
+            cn_keccakf_x4_avx2(ctx + first, std::min<size_t>(4, count - first));
+        }
+        return;
+    }
+#endif
+
+    for (size_t n = 0; n < count; n++)
+    {
+        keccakf(reinterpret_cast<uint64_t *>(ctx[n]->hash_state), 24);
+    }
+}
+
+#endif
@@ -0,0 +1,47 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#ifndef QRYPTONIGHT_CNKECCAK_H
+#define QRYPTONIGHT_CNKECCAK_H
+
+#include "cnkernel.h"
+
+// Keccak for the prologue and epilogue of an interleaved pass. With AVX2
+// four lanes go through a single vectorized permutation, otherwise the
+// scalar keccak is used lane by lane
+
+// keccak1600 of count inputs of len bytes each, stored back to back, into
+// ctx[n]->hash_state
+void cn_keccak1600_batch(const uint8_t *input, size_t len, cn_context **ctx, size_t count);
+
+// keccakf (24 rounds) of ctx[n]->hash_state for count contexts
+void cn_keccakf_batch(cn_context **ctx, size_t count);
+
+#if defined(__x86_64__) || defined(_M_X64)
+// Four lane AVX2 versions, only call them after checking the CPU supports
+// AVX2. Unused lanes (count < 4) cost nothing extra
+void cn_keccak1600_x4_avx2(const uint8_t *input, size_t len, cn_context **ctx, size_t count);
+void cn_keccakf_x4_avx2(cn_context **ctx, size_t count);
+#endif
+
+#endif //QRYPTONIGHT_CNKECCAK_H
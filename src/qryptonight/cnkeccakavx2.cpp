@@ -0,0 +1,200 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#if (defined(__linux__) || defined(__APPLE__)) && (defined(__x86_64__) || defined(_M_X64))
+
+// This file is compiled with AVX2 enabled (see CMakeLists.txt). It must only
+// run after checking the CPU supports it
+
+#include <immintrin.h>
+#include <cstring>
+#include "cnkeccak.h"
+
+namespace {
+
+const uint64_t round_constants[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+    0x000000000000808bULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008aULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+    0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800aULL, 0x800000008000000aULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL,
+};
+
+// rho rotation of lane x + 5y
+const int rho[25] = {
+     0,  1, 62, 28, 27,
+    36, 44,  6, 55, 20,
+     3, 10, 43, 25, 39,
+    41, 45, 15, 21,  8,
+    18,  2, 61, 56, 14,
+};
+
+inline __m256i rotl(__m256i x, int n)
+{
+    return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n));
+}
+
+// Keccak-f[1600], element k of every vector belongs to lane k
+void keccakf_x4(__m256i *a)
+{
+    for (int round = 0; round < 24; round++)
+    {
+        __m256i c[5];
+        __m256i b[25];
+
+        // theta
+        for (int x = 0; x < 5; x++)
+        {
+            c[x] = _mm256_xor_si256(_mm256_xor_si256(a[x], a[x + 5]),
+                                    _mm256_xor_si256(_mm256_xor_si256(a[x + 10], a[x + 15]), a[x + 20]));
+        }
+        for (int x = 0; x < 5; x++)
+        {
+            const __m256i d = _mm256_xor_si256(c[(x + 4) % 5], rotl(c[(x + 1) % 5], 1));
+            for (int y = 0; y < 25; y += 5)
+            {
+                a[x + y] = _mm256_xor_si256(a[x + y], d);
+            }
+        }
+
+        // rho and pi
+        for (int x = 0; x < 5; x++)
+        {
+            for (int y = 0; y < 5; y++)
+            {
+                b[y + 5 * ((2 * x + 3 * y) % 5)] = rotl(a[x + 5 * y], rho[x + 5 * y]);
+            }
+        }
+
+        // chi
+        for (int y = 0; y < 25; y += 5)
+        {
+            for (int x = 0; x < 5; x++)
+            {
+                a[x + y] = _mm256_xor_si256(b[x + y], _mm256_andnot_si256(b[(x + 1) % 5 + y], b[(x + 2) % 5 + y]));
+            }
+        }
+
+        // iota
+        a[0] = _mm256_xor_si256(a[0], _mm256_set1_epi64x(static_cast<int64_t>(round_constants[round])));
+    }
+}
+
+inline uint64_t load64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Lane k reads from in[k], unused lanes read lane 0 again
+inline __m256i gather64(const uint8_t * const *in, size_t offset)
+{
+    return _mm256_set_epi64x(static_cast<int64_t>(load64(in[3] + offset)),
+                             static_cast<int64_t>(load64(in[2] + offset)),
+                             static_cast<int64_t>(load64(in[1] + offset)),
+                             static_cast<int64_t>(load64(in[0] + offset)));
+}
+
+void store_states(const __m256i *a, cn_context **ctx, size_t count)
+{
+    alignas(32) uint64_t words[4];
+    for (int i = 0; i < 25; i++)
+    {
+        _mm256_store_si256(reinterpret_cast<__m256i *>(words), a[i]);
+        for (size_t n = 0; n < count; n++)
+        {
+            memcpy(ctx[n]->hash_state + 8 * i, &words[n], 8);
+        }
+    }
+}
+
+}
+
+void cn_keccak1600_x4_avx2(const uint8_t *input, size_t len, cn_context **ctx, size_t count)
+{
+    // same rate and padding as keccak1600()
+    const size_t rate = 136;
+
+    const uint8_t *in[4];
+    for (size_t n = 0; n < 4; n++)
+    {
+        in[n] = input + (n < count ? n : 0) * len;
+    }
+
+    __m256i a[25];
+    for (auto &lane : a)
+    {
+        lane = _mm256_setzero_si256();
+    }
+
+    size_t offset = 0;
+    for (; len - offset >= rate; offset += rate)
+    {
+        for (size_t i = 0; i < rate / 8; i++)
+        {
+            a[i] = _mm256_xor_si256(a[i], gather64(in, offset + 8 * i));
+        }
+        keccakf_x4(a);
+    }
+
+    uint8_t last[4][rate];
+    const uint8_t *tail[4];
+    const size_t remaining = len - offset;
+    for (size_t n = 0; n < 4; n++)
+    {
+        memcpy(last[n], in[n] + offset, remaining);
+        last[n][remaining] = 1;
+        memset(last[n] + remaining + 1, 0, rate - remaining - 1);
+        last[n][rate - 1] |= 0x80;
+        tail[n] = last[n];
+    }
+    for (size_t i = 0; i < rate / 8; i++)
+    {
+        a[i] = _mm256_xor_si256(a[i], gather64(tail, 8 * i));
+    }
+    keccakf_x4(a);
+
+    store_states(a, ctx, count);
+}
+
+void cn_keccakf_x4_avx2(cn_context **ctx, size_t count)
+{
+    const uint8_t *states[4];
+    for (size_t n = 0; n < 4; n++)
+    {
+        states[n] = ctx[n < count ? n : 0]->hash_state;
+    }
+
+    __m256i a[25];
+    for (int i = 0; i < 25; i++)
+    {
+        a[i] = gather64(states, 8 * i);
+    }
+    keccakf_x4(a);
+
+    store_states(a, ctx, count);
+}
+
+#endif
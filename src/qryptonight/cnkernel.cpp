@@ -0,0 +1,146 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include "cnkernel.h"
+#include "cnbackend.h"
+#include "scratchpadarena.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+
+const char *cn_page_type_name(cn_page_type pages)
+{
+    switch (pages)
+    {
+        case CN_PAGES_THP: return "thp";
+        case CN_PAGES_2M: return "2m";
+        case CN_PAGES_1G: return "1g";
+        default: return "4k";
+    }
+}
+
+namespace
+{
+    std::atomic<uint64_t> scratchpad_bytes[CN_PAGES_1G + 1];
+}
+
+uint64_t cn_scratchpad_bytes(cn_page_type pages)
+{
+    return scratchpad_bytes[pages].load(std::memory_order_relaxed);
+}
+
+cn_context *cn_alloc_context(std::string &error, const std::shared_ptr<ScratchpadArena> &arena)
+{
+    auto ctx = new (std::nothrow) cn_context();
+    if (ctx == nullptr)
+    {
+        error = "failed to allocate cryptonight context";
+        return nullptr;
+    }
+
+    if (arena && (ctx->long_state = arena->acquire()) != nullptr)
+    {
+        ctx->pages = arena->pageType();
+        ctx->arena = arena;
+        scratchpad_bytes[ctx->pages].fetch_add(CN_MEMORY, std::memory_order_relaxed);
+        return ctx;
+    }
+
+    // 2 MB aligned, so the scratchpad can sit in a single transparent huge page
+    void *mem = nullptr;
+    if (posix_memalign(&mem, CN_MEMORY, CN_MEMORY) != 0)
+    {
+        mem = nullptr;
+    }
+    if (mem == nullptr)
+    {
+        delete ctx;
+        error = "failed to allocate cryptonight scratchpad";
+        return nullptr;
+    }
+
+    ctx->long_state = static_cast<uint8_t *>(mem);
+    ctx->pages = CN_PAGES_4K;
+#if defined(MADV_HUGEPAGE)
+    if (madvise(mem, CN_MEMORY, MADV_HUGEPAGE) == 0 && thpEnabled())
+    {
+        ctx->pages = CN_PAGES_THP;
+    }
+#endif
+    scratchpad_bytes[ctx->pages].fetch_add(CN_MEMORY, std::memory_order_relaxed);
+    return ctx;
+}
+
+void cn_free_context(cn_context *ctx)
+{
+    if (ctx == nullptr)
+    {
+        return;
+    }
+
+    scratchpad_bytes[ctx->pages].fetch_sub(CN_MEMORY, std::memory_order_relaxed);
+    if (ctx->arena)
+    {
+        ctx->arena->release(ctx->long_state);
+    }
+    else
+    {
+        free(ctx->long_state);
+    }
+    delete ctx;
+}
+
+void cn_prefault_context(cn_context *ctx)
+{
+    volatile uint8_t *state = ctx->long_state;
+    for (size_t offset = 0; offset < CN_MEMORY; offset += 4096)
+    {
+        state[offset] = 0;
+    }
+}
+
+bool cn_discard_context(cn_context *ctx, bool lazy)
+{
+#if defined(MADV_FREE)
+    if (lazy && madvise(ctx->long_state, CN_MEMORY, MADV_FREE) == 0)
+    {
+        return true;
+    }
+#endif
+    return madvise(ctx->long_state, CN_MEMORY, MADV_DONTNEED) == 0;
+}
+
+void cn_hash(const uint8_t *input, size_t len, uint8_t *output, cn_context *ctx)
+{
+    CnBackendRegistry::instance().active().kernels[CN_ALGO_QRL](input, len, output, &ctx, 1);
+}
+
+void cn_hash_ways(const uint8_t *input, size_t len, uint8_t *output, cn_context **ctx, size_t ways)
+{
+    CnBackendRegistry::instance().active().kernels[CN_ALGO_QRL](input, len, output, ctx, ways);
+}
+
+#endif
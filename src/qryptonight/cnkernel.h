@@ -0,0 +1,111 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#ifndef QRYPTONIGHT_CNKERNEL_H
+#define QRYPTONIGHT_CNKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// CryptoNight variant 1 parameters, as used by QRL
+#define CN_MEMORY       (1 << 21)                   // scratchpad size in bytes
+#define CN_ITERATIONS   (1 << 19)                   // main loop iterations
+#define CN_MASK         ((CN_MEMORY - 1) & ~0xF)    // 16-byte aligned scratchpad offsets
+
+// Maximum number of hashes computed in one interleaved pass
+#define CN_MAX_WAYS     5
+
+// CryptoNight parameters. Kernels are instantiated per parameter set, so the
+// main loop carries no runtime branches on them
+template<int Variant, size_t Memory, size_t Iterations>
+struct CnAlgo
+{
+    static_assert(Variant == 0 || Variant == 1, "unsupported cryptonight variant");
+    static_assert(Memory >= 128 && Memory <= CN_MEMORY && (Memory & (Memory - 1)) == 0,
+                  "scratchpad size must be a power of two that fits in a cn_context");
+
+    static constexpr int variant = Variant;
+    static constexpr size_t memory = Memory;
+    static constexpr size_t iterations = Iterations;
+    static constexpr size_t mask = (Memory - 1) & ~static_cast<size_t>(0xF);
+};
+
+// The parameters QRL uses, see CN_MEMORY and CN_ITERATIONS
+typedef CnAlgo<1, CN_MEMORY, CN_ITERATIONS> CnQrlAlgo;
+
+// Kind of pages backing a scratchpad. CN_PAGES_THP means the scratchpad is
+// 2 MB aligned and eligible for transparent huge pages, which the kernel may
+// or may not have granted
+enum cn_page_type
+{
+    CN_PAGES_4K,
+    CN_PAGES_THP,
+    CN_PAGES_2M,
+    CN_PAGES_1G
+};
+
+// "4k", "thp", "2m" or "1g"
+const char *cn_page_type_name(cn_page_type pages);
+
+class ScratchpadArena;
+
+// Hashing context owned by a single Qryptonight instance. It plays the role
+// of xmr-stak's cryptonight_ctx for the Linux/macOS build: the scratchpad is
+// allocated once and reused for every hash instead of living in hidden
+// thread-local storage inside cn_slow_hash
+struct cn_context
+{
+    uint8_t *long_state;                    // CN_MEMORY bytes, 2 MB aligned
+    alignas(16) uint8_t hash_state[200];    // keccak-1600 state
+
+    cn_page_type pages;
+    std::shared_ptr<ScratchpadArena> arena; // owner of long_state, if any
+};
+
+// Scratchpad bytes currently allocated on pages of the given type
+uint64_t cn_scratchpad_bytes(cn_page_type pages);
+
+// Returns nullptr and fills error if the scratchpad cannot be allocated.
+// The scratchpad is taken from arena while it has free slots
+cn_context *cn_alloc_context(std::string &error, const std::shared_ptr<ScratchpadArena> &arena = nullptr);
+void cn_free_context(cn_context *ctx);
+
+// Touches every page of the scratchpad so the first hash does not fault
+void cn_prefault_context(cn_context *ctx);
+
+// Hands the scratchpad pages back to the kernel but keeps the mapping, the
+// next hash faults them in again. lazy uses MADV_FREE, which lets the kernel
+// reclaim the pages only under memory pressure. False if not supported
+bool cn_discard_context(cn_context *ctx, bool lazy);
+
+// Computes the 32-byte CryptoNight variant 1 hash of input (len >= 43)
+void cn_hash(const uint8_t *input, size_t len, uint8_t *output, cn_context *ctx);
+
+// Computes ways (1..CN_MAX_WAYS) hashes in a single interleaved pass, each
+// lane using its own context. Inputs are stored back to back, len bytes each,
+// and the 32-byte outputs are written back to back
+void cn_hash_ways(const uint8_t *input, size_t len, uint8_t *output, cn_context **ctx, size_t ways);
+
+#endif //QRYPTONIGHT_CNKERNEL_H
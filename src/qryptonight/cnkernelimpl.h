@@ -0,0 +1,251 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#ifndef QRYPTONIGHT_CNKERNELIMPL_H
+#define QRYPTONIGHT_CNKERNELIMPL_H
+
+// Building blocks shared by the CryptoNight backends. Only include this from
+// backend translation units (cnsoft.cpp, cnaesni.cpp, ...).
+//
+// Everything in here has internal linkage on purpose: each backend is compiled
+// with its own instruction set flags, and inline code instantiated with e.g.
+// -maes must never be merged by the linker into a backend that runs on CPUs
+// without it.
+
+#include "cnkernel.h"
+#include "cnbackend.h"
+#include <cstring>
+
+#include "cnkeccak.h"
+#include "hash-ops.h"
+
+namespace {
+
+constexpr uint8_t aes_sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+constexpr uint8_t gf_mul2(uint8_t x)
+{
+    return static_cast<uint8_t>((x << 1) ^ ((x & 0x80) ? 0x1b : 0));
+}
+
+// Combined SubBytes/ShiftRows/MixColumns lookup tables for the soft AES round
+struct SoftAesTables
+{
+    uint32_t t[4][256];
+
+    constexpr SoftAesTables() : t()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            const uint32_t s = aes_sbox[i];
+            const uint32_t s2 = gf_mul2(aes_sbox[i]);
+            const uint32_t w = s2 | (s << 8) | (s << 16) | ((s2 ^ s) << 24);
+            t[0][i] = w;
+            t[1][i] = (w << 8) | (w >> 24);
+            t[2][i] = (w << 16) | (w >> 16);
+            t[3][i] = (w << 24) | (w >> 8);
+        }
+    }
+};
+
+constexpr SoftAesTables soft_aes;
+
+inline uint32_t aes_sub_word(uint32_t w)
+{
+    return static_cast<uint32_t>(aes_sbox[w & 0xff]) |
+           (static_cast<uint32_t>(aes_sbox[(w >> 8) & 0xff]) << 8) |
+           (static_cast<uint32_t>(aes_sbox[(w >> 16) & 0xff]) << 16) |
+           (static_cast<uint32_t>(aes_sbox[w >> 24]) << 24);
+}
+
+// AES-256 key schedule truncated to the 10 round keys CryptoNight uses
+void aes_expand_key(const uint8_t *key, uint32_t *round_keys)
+{
+    static const uint32_t rcon[4] = { 0x01, 0x02, 0x04, 0x08 };
+
+    memcpy(round_keys, key, 32);
+    for (int i = 8; i < 40; i++)
+    {
+        uint32_t t = round_keys[i - 1];
+        if (i % 8 == 0)
+        {
+            t = aes_sub_word((t >> 8) | (t << 24)) ^ rcon[i / 8 - 1];
+        }
+        else if (i % 8 == 4)
+        {
+            t = aes_sub_word(t);
+        }
+        round_keys[i] = round_keys[i - 8] ^ t;
+    }
+}
+
+// One AES encryption round, equivalent to _mm_aesenc_si128
+inline void soft_aesenc(uint32_t *x, const uint32_t *key)
+{
+    const uint32_t x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3];
+
+    x[0] = soft_aes.t[0][x0 & 0xff] ^ soft_aes.t[1][(x1 >> 8) & 0xff] ^
+           soft_aes.t[2][(x2 >> 16) & 0xff] ^ soft_aes.t[3][x3 >> 24] ^ key[0];
+    x[1] = soft_aes.t[0][x1 & 0xff] ^ soft_aes.t[1][(x2 >> 8) & 0xff] ^
+           soft_aes.t[2][(x3 >> 16) & 0xff] ^ soft_aes.t[3][x0 >> 24] ^ key[1];
+    x[2] = soft_aes.t[0][x2 & 0xff] ^ soft_aes.t[1][(x3 >> 8) & 0xff] ^
+           soft_aes.t[2][(x0 >> 16) & 0xff] ^ soft_aes.t[3][x1 >> 24] ^ key[2];
+    x[3] = soft_aes.t[0][x3 & 0xff] ^ soft_aes.t[1][(x0 >> 8) & 0xff] ^
+           soft_aes.t[2][(x1 >> 16) & 0xff] ^ soft_aes.t[3][x2 >> 24] ^ key[3];
+}
+
+inline uint64_t mul128(uint64_t a, uint64_t b, uint64_t *hi)
+{
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+    *hi = static_cast<uint64_t>(r >> 64);
+    return static_cast<uint64_t>(r);
+#else
+    const uint64_t a_lo = a & 0xffffffff, a_hi = a >> 32;
+    const uint64_t b_lo = b & 0xffffffff, b_hi = b >> 32;
+    const uint64_t lo_lo = a_lo * b_lo;
+    const uint64_t hi_lo = a_hi * b_lo;
+    const uint64_t lo_hi = a_lo * b_hi;
+    const uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+    *hi = a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+    return (cross << 32) | (lo_lo & 0xffffffff);
+#endif
+}
+
+inline uint64_t load64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Variant 1 tweak applied to the block written back in the first half-step
+inline uint64_t variant1_tweak(uint64_t hi)
+{
+    const uint8_t tmp = static_cast<uint8_t>(hi >> 24);
+    const uint8_t index = static_cast<uint8_t>((((tmp >> 3) & 6) | (tmp & 1)) << 1);
+    return hi ^ (static_cast<uint64_t>((0x75310 >> index) & 0x30) << 24);
+}
+
+void (* const extra_hashes[4])(const void *, size_t, char *) = {
+    hash_extra_blake, hash_extra_groestl, hash_extra_jh, hash_extra_skein
+};
+
+// Base for kernels whose explode and implode phases work on one scratchpad
+// at a time. Kernel provides explode<Algo>(state, long_state) and
+// implode<Algo>(long_state, state)
+template<class Kernel>
+struct LaneKernel
+{
+    template<class Algo, size_t N>
+    static void explode_n(cn_context **ctx)
+    {
+        for (size_t n = 0; n < N; n++)
+        {
+            Kernel::template explode<Algo>(ctx[n]->hash_state, ctx[n]->long_state);
+        }
+    }
+
+    template<class Algo, size_t N>
+    static void implode_n(cn_context **ctx)
+    {
+        for (size_t n = 0; n < N; n++)
+        {
+            Kernel::template implode<Algo>(ctx[n]->long_state, ctx[n]->hash_state);
+        }
+    }
+};
+
+// Full hash of N inputs. Kernel provides the explode, main loop and implode
+// phases; keccak and the final hashes are common to all backends
+template<class Kernel, class Algo, size_t N>
+void cn_hash_n(const uint8_t *input, size_t len, uint8_t *output, cn_context **ctx)
+{
+    uint64_t tweak[N] = {};
+
+    cn_keccak1600_batch(input, len, ctx, N);
+    if constexpr (Algo::variant == 1)
+    {
+        for (size_t n = 0; n < N; n++)
+        {
+            tweak[n] = load64(ctx[n]->hash_state + 192) ^ load64(input + n * len + 35);
+        }
+    }
+
+    Kernel::template explode_n<Algo, N>(ctx);
+    Kernel::template main_loop<Algo, N>(ctx, tweak);
+    Kernel::template implode_n<Algo, N>(ctx);
+
+    cn_keccakf_batch(ctx, N);
+    for (size_t n = 0; n < N; n++)
+    {
+        uint8_t *state = ctx[n]->hash_state;
+        extra_hashes[state[0] & 3](state, 200, reinterpret_cast<char *>(output + n * 32));
+    }
+}
+
+template<class Kernel, class Algo>
+void cn_hash_ways_impl(const uint8_t *input, size_t len, uint8_t *output, cn_context **ctx, size_t ways)
+{
+    switch (ways)
+    {
+        case 1: cn_hash_n<Kernel, Algo, 1>(input, len, output, ctx); break;
+        case 2: cn_hash_n<Kernel, Algo, 2>(input, len, output, ctx); break;
+        case 3: cn_hash_n<Kernel, Algo, 3>(input, len, output, ctx); break;
+        case 4: cn_hash_n<Kernel, Algo, 4>(input, len, output, ctx); break;
+        case 5: cn_hash_n<Kernel, Algo, 5>(input, len, output, ctx); break;
+        default: break;
+    }
+}
+
+// Entry points of a kernel for every algorithm in CnAlgoId
+template<class Kernel>
+constexpr CnKernels cn_kernels()
+{
+    return {{
+        cn_hash_ways_impl<Kernel, CnQrlAlgo>,
+        cn_hash_ways_impl<Kernel, CnTestAlgo>,
+        cn_hash_ways_impl<Kernel, CnV0Algo>,
+    }};
+}
+
+}
+
+#endif //QRYPTONIGHT_CNKERNELIMPL_H
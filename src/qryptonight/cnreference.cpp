@@ -0,0 +1,57 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include "cnbackend.h"
+#include "hash-ops.h"
+
+namespace {
+
+// The reference cn_slow_hash, built with the host's flags. On ARM it is the
+// only backend with hardware AES; it keeps its own scratchpad per thread, so
+// the contexts are not used
+template<int Variant>
+void reference_hash_ways(const uint8_t *input, size_t len, uint8_t *output, cn_context **, size_t ways)
+{
+    for (size_t n = 0; n < ways; n++)
+    {
+        cn_slow_hash(input + n * len, len, reinterpret_cast<char *>(output + n * 32), Variant, 0, 0);
+    }
+}
+
+// the reference has no reduced variant, the soft kernel stands in for it
+void reference_test_ways(const uint8_t *input, size_t len, uint8_t *output, cn_context **ctx, size_t ways)
+{
+    cn_kernels_soft[CN_ALGO_TEST](input, len, output, ctx, ways);
+}
+
+}
+
+const CnKernels cn_kernels_reference = {{
+    reference_hash_ways<1>,
+    reference_test_ways,
+    reference_hash_ways<0>,
+}};
+
+#endif
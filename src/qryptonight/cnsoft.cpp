@@ -0,0 +1,158 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include "cnkernelimpl.h"
+#include "cnbackend.h"
+
+namespace {
+
+// Portable backend: table based AES rounds, runs on any CPU
+struct SoftKernel : LaneKernel<SoftKernel>
+{
+    template<class Algo>
+    static void explode(const uint8_t *state, uint8_t *long_state)
+    {
+        uint32_t round_keys[40];
+        uint32_t text[32];
+
+        aes_expand_key(state, round_keys);
+        memcpy(text, state + 64, sizeof(text));
+
+        for (size_t i = 0; i < Algo::memory; i += sizeof(text))
+        {
+            for (size_t j = 0; j < 32; j += 4)
+            {
+                for (size_t k = 0; k < 40; k += 4)
+                {
+                    soft_aesenc(text + j, round_keys + k);
+                }
+            }
+            memcpy(long_state + i, text, sizeof(text));
+        }
+    }
+
+    template<class Algo>
+    static void implode(const uint8_t *long_state, uint8_t *state)
+    {
+        uint32_t round_keys[40];
+        uint32_t text[32];
+        uint32_t block[32];
+
+        aes_expand_key(state + 32, round_keys);
+        memcpy(text, state + 64, sizeof(text));
+
+        for (size_t i = 0; i < Algo::memory; i += sizeof(text))
+        {
+            memcpy(block, long_state + i, sizeof(block));
+            for (size_t j = 0; j < 32; j += 4)
+            {
+                text[j] ^= block[j];
+                text[j + 1] ^= block[j + 1];
+                text[j + 2] ^= block[j + 2];
+                text[j + 3] ^= block[j + 3];
+                for (size_t k = 0; k < 40; k += 4)
+                {
+                    soft_aesenc(text + j, round_keys + k);
+                }
+            }
+        }
+        memcpy(state + 64, text, sizeof(text));
+    }
+
+    // Main loop over N independent scratchpads. The N dependency chains are
+    // interleaved step by step so the memory latency of one lane is hidden
+    // behind the work of the others
+    template<class Algo, size_t N>
+    static void main_loop(cn_context **ctx, const uint64_t *tweak)
+    {
+        uint8_t *l[N];
+        uint64_t a[N][2];
+        uint64_t b[N][2];
+
+        for (size_t n = 0; n < N; n++)
+        {
+            const uint8_t *state = ctx[n]->hash_state;
+            l[n] = ctx[n]->long_state;
+            a[n][0] = load64(state) ^ load64(state + 32);
+            a[n][1] = load64(state + 8) ^ load64(state + 40);
+            b[n][0] = load64(state + 16) ^ load64(state + 48);
+            b[n][1] = load64(state + 24) ^ load64(state + 56);
+        }
+
+        for (size_t i = 0; i < Algo::iterations; i++)
+        {
+            uint64_t cx[N][2];
+
+            for (size_t n = 0; n < N; n++)
+            {
+                uint8_t *p = l[n] + (a[n][0] & Algo::mask);
+
+                uint32_t c[4];
+                uint32_t key[4];
+                memcpy(c, p, sizeof(c));
+                memcpy(key, a[n], sizeof(key));
+                soft_aesenc(c, key);
+                memcpy(cx[n], c, sizeof(c));
+
+                uint64_t v[2] = { cx[n][0] ^ b[n][0], cx[n][1] ^ b[n][1] };
+                if constexpr (Algo::variant == 1)
+                {
+                    v[1] = variant1_tweak(v[1]);
+                }
+                memcpy(p, v, sizeof(v));
+                b[n][0] = cx[n][0];
+                b[n][1] = cx[n][1];
+            }
+
+            for (size_t n = 0; n < N; n++)
+            {
+                uint8_t *p = l[n] + (cx[n][0] & Algo::mask);
+                uint64_t d[2];
+                memcpy(d, p, sizeof(d));
+
+                uint64_t hi;
+                const uint64_t lo = mul128(cx[n][0], d[0], &hi);
+                a[n][0] += hi;
+                a[n][1] += lo;
+
+                uint64_t v[2] = { a[n][0], a[n][1] };
+                if constexpr (Algo::variant == 1)
+                {
+                    v[1] ^= tweak[n];
+                }
+                memcpy(p, v, sizeof(v));
+
+                a[n][0] ^= d[0];
+                a[n][1] ^= d[1];
+            }
+        }
+    }
+};
+
+}
+
+const CnKernels cn_kernels_soft = cn_kernels<SoftKernel>();
+
+#endif
@@ -0,0 +1,56 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#if (defined(__linux__) || defined(__APPLE__)) && (defined(__x86_64__) || defined(_M_X64)) && defined(QRYPTONIGHT_HAVE_VAES)
+
+// This file is compiled with AES-NI, AVX-512F and VAES enabled (see CMakeLists.txt).
+// It must only run after CnBackendRegistry has checked the CPU supports them
+
+#include "cnvaesimpl.h"
+#include "cnbackend.h"
+
+namespace {
+
+struct Vaes512
+{
+    typedef __m512i vec;
+    static constexpr size_t bytes = 64;
+
+    static vec load(const uint8_t *p) { return _mm512_load_si512(p); }
+    static vec loadu(const uint8_t *p) { return _mm512_loadu_si512(p); }
+    static void store(uint8_t *p, vec v) { _mm512_store_si512(p, v); }
+    static void storeu(uint8_t *p, vec v) { _mm512_storeu_si512(p, v); }
+    static vec bxor(vec a, vec b) { return _mm512_xor_si512(a, b); }
+    static vec aesenc(vec a, vec key) { return _mm512_aesenc_epi128(a, key); }
+
+    static vec broadcast(const uint32_t *key)
+    {
+        return _mm512_maskz_broadcast_i32x4(0xffff, _mm_loadu_si128(reinterpret_cast<const __m128i *>(key)));
+    }
+};
+
+}
+
+const CnKernels cn_kernels_vaes512 = cn_kernels<VaesKernel<Vaes512>>();
+
+#endif
@@ -0,0 +1,143 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#ifndef QRYPTONIGHT_CNVAESIMPL_H
+#define QRYPTONIGHT_CNVAESIMPL_H
+
+// Only include this from the VAES backend translation units, compiled with
+// AES-NI and VAES enabled (see CMakeLists.txt)
+
+#include "cnaesniimpl.h"
+
+namespace {
+
+// Explode and implode with vector AES, V::bytes / 16 blocks per instruction.
+// A 128-byte text block only holds 8 independent AES chains, so the N lanes
+// of an interleaved pass are processed together to keep the AES units busy.
+// The main loop works on a single block per step and is the AES-NI one.
+//
+// V wraps the vector type: load/loadu, store/storeu, bxor, aesenc and
+// broadcast (a 16-byte round key to every block)
+template<class V>
+struct VaesKernel : AesNiKernel
+{
+    typedef typename V::vec vec;
+
+    static constexpr size_t vecs = 128 / V::bytes;
+
+    template<class Algo, size_t N>
+    static void explode_n(cn_context **ctx)
+    {
+        vec k[N][10];
+        vec x[N][vecs];
+
+        for (size_t n = 0; n < N; n++)
+        {
+            uint32_t round_keys[40];
+            aes_expand_key(ctx[n]->hash_state, round_keys);
+            for (size_t r = 0; r < 10; r++)
+            {
+                k[n][r] = V::broadcast(round_keys + 4 * r);
+            }
+            for (size_t j = 0; j < vecs; j++)
+            {
+                x[n][j] = V::loadu(ctx[n]->hash_state + 64 + j * V::bytes);
+            }
+        }
+
+        for (size_t i = 0; i < Algo::memory; i += 128)
+        {
+            for (size_t r = 0; r < 10; r++)
+            {
+                for (size_t n = 0; n < N; n++)
+                {
+                    for (size_t j = 0; j < vecs; j++)
+                    {
+                        x[n][j] = V::aesenc(x[n][j], k[n][r]);
+                    }
+                }
+            }
+            for (size_t n = 0; n < N; n++)
+            {
+                for (size_t j = 0; j < vecs; j++)
+                {
+                    V::store(ctx[n]->long_state + i + j * V::bytes, x[n][j]);
+                }
+            }
+        }
+    }
+
+    template<class Algo, size_t N>
+    static void implode_n(cn_context **ctx)
+    {
+        vec k[N][10];
+        vec x[N][vecs];
+
+        for (size_t n = 0; n < N; n++)
+        {
+            uint32_t round_keys[40];
+            aes_expand_key(ctx[n]->hash_state + 32, round_keys);
+            for (size_t r = 0; r < 10; r++)
+            {
+                k[n][r] = V::broadcast(round_keys + 4 * r);
+            }
+            for (size_t j = 0; j < vecs; j++)
+            {
+                x[n][j] = V::loadu(ctx[n]->hash_state + 64 + j * V::bytes);
+            }
+        }
+
+        for (size_t i = 0; i < Algo::memory; i += 128)
+        {
+            for (size_t n = 0; n < N; n++)
+            {
+                for (size_t j = 0; j < vecs; j++)
+                {
+                    x[n][j] = V::bxor(x[n][j], V::load(ctx[n]->long_state + i + j * V::bytes));
+                }
+            }
+            for (size_t r = 0; r < 10; r++)
+            {
+                for (size_t n = 0; n < N; n++)
+                {
+                    for (size_t j = 0; j < vecs; j++)
+                    {
+                        x[n][j] = V::aesenc(x[n][j], k[n][r]);
+                    }
+                }
+            }
+        }
+
+        for (size_t n = 0; n < N; n++)
+        {
+            for (size_t j = 0; j < vecs; j++)
+            {
+                V::storeu(ctx[n]->hash_state + 64 + j * V::bytes, x[n][j]);
+            }
+        }
+    }
+};
+
+}
+
+#endif //QRYPTONIGHT_CNVAESIMPL_H
@@ -0,0 +1,138 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#include "cpufeatures.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define QRYPTONIGHT_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+#if defined(QRYPTONIGHT_X86)
+
+    void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+    {
+#if defined(_MSC_VER)
+        __cpuidex(reinterpret_cast<int*>(regs), static_cast<int>(leaf), static_cast<int>(subleaf));
+#else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    uint64_t xgetbv0()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+    }
+
+    CpuFeatures detectCpuFeatures()
+    {
+        CpuFeatures features;
+        uint32_t regs[4];
+
+        cpuid(0, 0, regs);
+        const uint32_t max_leaf = regs[0];
+        if (max_leaf<1)
+        {
+            return features;
+        }
+
+        cpuid(1, 0, regs);
+        features.sse2 = (regs[3] & (1u << 26)) != 0;
+        features.sse41 = (regs[2] & (1u << 19)) != 0;
+        features.aes = (regs[2] & (1u << 25)) != 0;
+
+        // AVX and AVX-512 also need the OS to save the wider registers
+        const bool osxsave = (regs[2] & (1u << 27)) != 0;
+        const uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+        const bool os_avx = (xcr0 & 0x06) == 0x06;
+        const bool os_avx512 = (xcr0 & 0xE6) == 0xE6;
+
+        features.avx = os_avx && (regs[2] & (1u << 28)) != 0;
+
+        if (max_leaf>=7)
+        {
+            cpuid(7, 0, regs);
+            features.avx2 = features.avx && (regs[1] & (1u << 5)) != 0;
+            features.avx512f = os_avx512 && (regs[1] & (1u << 16)) != 0;
+            features.avx512vl = features.avx512f && (regs[1] & (1u << 31)) != 0;
+            features.vaes = features.avx && (regs[2] & (1u << 9)) != 0;
+        }
+
+        return features;
+    }
+
+#else
+
+    CpuFeatures detectCpuFeatures()
+    {
+        return CpuFeatures();
+    }
+
+#endif
+
+}
+
+const CpuFeatures& getCpuFeatures()
+{
+    static const CpuFeatures features = detectCpuFeatures();
+    return features;
+}
+
+std::string getCpuBrand()
+{
+#if defined(QRYPTONIGHT_X86)
+    uint32_t regs[4];
+    cpuid(0x80000000, 0, regs);
+    if (regs[0]<0x80000004)
+    {
+        return "";
+    }
+
+    char brand[49] = {};
+    for (uint32_t i = 0; i<3; i++)
+    {
+        cpuid(0x80000002+i, 0, regs);
+        memcpy(brand+16*i, regs, sizeof(regs));
+    }
+
+    std::string result(brand);
+    const auto first = result.find_first_not_of(' ');
+    return first==std::string::npos ? "" : result.substr(first);
+#else
+    return "";
+#endif
+}
@@ -0,0 +1,48 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#ifndef QRYPTONIGHT_CPUFEATURES_H
+#define QRYPTONIGHT_CPUFEATURES_H
+
+#include <string>
+
+// Instruction set extensions detected at runtime. Flags are only set when
+// both the CPU and the operating system (saved register state) support them
+struct CpuFeatures
+{
+    bool sse2 = false;
+    bool sse41 = false;
+    bool aes = false;
+    bool avx = false;
+    bool avx2 = false;
+    bool avx512f = false;
+    bool avx512vl = false;
+    bool vaes = false;
+};
+
+const CpuFeatures& getCpuFeatures();
+
+// CPU model name as reported by the processor, or an empty string
+std::string getCpuBrand();
+
+#endif //QRYPTONIGHT_CPUFEATURES_H
@@ -0,0 +1,115 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#include "forkhandlers.h"
+#include <algorithm>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+ForkHandlers &ForkHandlers::instance()
+{
+    static ForkHandlers handlers;
+    return handlers;
+}
+
+ForkHandlers::ForkHandlers()
+{
+#if defined(__linux__) || defined(__APPLE__)
+    pthread_atfork(prepareFork, parentAfterFork, childAfterFork);
+#endif
+}
+
+size_t ForkHandlers::add(Handlers handlers)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const size_t id = _next_id++;
+    _handlers.emplace_back(id, std::move(handlers));
+    return id;
+}
+
+void ForkHandlers::remove(size_t id)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _handlers.erase(std::remove_if(_handlers.begin(), _handlers.end(),
+                                   [id](const std::pair<size_t, Handlers> &entry) { return entry.first == id; }),
+                    _handlers.end());
+}
+
+void ForkHandlers::prepareFork()
+{
+    auto &self = instance();
+
+    // held until after the fork, so no handler comes or goes meanwhile
+    self._mutex.lock();
+
+    self._forking.clear();
+    for (const auto &entry : self._handlers)
+    {
+        self._forking.push_back(entry.second);
+    }
+    std::stable_sort(self._forking.begin(), self._forking.end(),
+                     [](const Handlers &a, const Handlers &b) { return a.phase < b.phase; });
+
+    for (auto it = self._forking.rbegin(); it != self._forking.rend(); ++it)
+    {
+        if (it->prepare)
+        {
+            it->prepare();
+        }
+    }
+}
+
+void ForkHandlers::parentAfterFork()
+{
+    auto &self = instance();
+    for (const auto &handlers : self._forking)
+    {
+        if (handlers.parent)
+        {
+            handlers.parent();
+        }
+    }
+    self._forking.clear();
+    self._mutex.unlock();
+}
+
+void ForkHandlers::childAfterFork()
+{
+    auto &self = instance();
+
+    // child handlers may free objects that remove themselves from here.
+    // Those of earlier phases have run by then
+    auto forking = std::move(self._forking);
+    self._forking.clear();
+    self._mutex.unlock();
+
+    for (const auto &handlers : forking)
+    {
+        if (handlers.child)
+        {
+            handlers.child();
+        }
+    }
+}
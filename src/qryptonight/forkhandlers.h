@@ -0,0 +1,80 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#ifndef QRYPTONIGHT_FORKHANDLERS_H
+#define QRYPTONIGHT_FORKHANDLERS_H
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Objects holding locks or threads register here to stay usable across
+// fork(), which only copies the forking thread into the child. prepare
+// runs in the parent before the fork, parent and child run after it in
+// their process. Handlers run in phase order after the fork and in
+// reverse order before it, so pools can still free scratchpads into
+// arenas in the child. A no-op on Windows, which has no fork()
+class ForkHandlers
+{
+public:
+    enum Phase
+    {
+        PHASE_ARENAS,
+        PHASE_POOLS,
+        PHASE_MINERS
+    };
+
+    struct Handlers
+    {
+        Phase phase;
+        std::function<void()> prepare;
+        std::function<void()> parent;
+        std::function<void()> child;
+    };
+
+    static ForkHandlers &instance();
+
+    ForkHandlers(const ForkHandlers &) = delete;
+    ForkHandlers &operator=(const ForkHandlers &) = delete;
+
+    // returns an id for remove()
+    size_t add(Handlers handlers);
+    void remove(size_t id);
+
+protected:
+    ForkHandlers();
+
+    static void prepareFork();
+    static void parentAfterFork();
+    static void childAfterFork();
+
+    std::mutex _mutex;
+    size_t _next_id = 0;
+    std::vector<std::pair<size_t, Handlers>> _handlers;
+
+    // snapshot taken by prepareFork, in phase order
+    std::vector<Handlers> _forking;
+};
+
+#endif //QRYPTONIGHT_FORKHANDLERS_H
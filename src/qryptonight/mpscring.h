@@ -0,0 +1,135 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#ifndef QRYPTONIGHT_MPSCRING_H
+#define QRYPTONIGHT_MPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Bounded lock-free queue for many producers and a single consumer. Every
+// slot carries a sequence number telling whose turn it is, so producers
+// only contend on the tail and never wait for each other
+template<typename T, size_t Capacity>
+class MpscRing
+{
+    static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    MpscRing()
+    {
+        reset();
+    }
+
+    MpscRing(const MpscRing &) = delete;
+    MpscRing &operator=(const MpscRing &) = delete;
+
+    // Any thread. Fails when the ring is full, or already holds limit or more
+    // entries, which lets callers keep the last slots for entries that matter more
+    bool push(T &&value, size_t limit = Capacity)
+    {
+        size_t pos = _tail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot &slot = _slots[pos & (Capacity - 1)];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+            if (diff == 0)
+            {
+                if (pos - _head.load(std::memory_order_acquire) >= limit)
+                {
+                    return false;
+                }
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.value = std::move(value);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // consumer only
+    bool pop(T &value)
+    {
+        const size_t pos = _head.load(std::memory_order_relaxed);
+        Slot &slot = _slots[pos & (Capacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+        {
+            return false;
+        }
+
+        value = std::move(slot.value);
+        slot.sequence.store(pos + Capacity, std::memory_order_release);
+        _head.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only
+    bool empty() const
+    {
+        const size_t pos = _head.load(std::memory_order_relaxed);
+        return _slots[pos & (Capacity - 1)].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    // drops all entries, only while no other thread uses the ring
+    void reset()
+    {
+        for (size_t i = 0; i < Capacity; i++)
+        {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        _head.store(0, std::memory_order_relaxed);
+        _tail.store(0, std::memory_order_relaxed);
+    }
+
+    static constexpr size_t capacity()
+    {
+        return Capacity;
+    }
+
+protected:
+    struct alignas(64) Slot
+    {
+        std::atomic<size_t> sequence{0};
+        T value;
+    };
+
+    alignas(64) std::atomic<size_t> _tail{0};
+    alignas(64) std::atomic<size_t> _head{0};
+    Slot _slots[Capacity];
+};
+
+#endif //QRYPTONIGHT_MPSCRING_H
@@ -0,0 +1,268 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#include "numatopology.h"
+
+#ifndef CONF_NO_HWLOC
+#include <hwloc.h>
+
+#if HWLOC_API_VERSION < 0x00010b00
+#define HWLOC_OBJ_NUMANODE HWLOC_OBJ_NODE
+#endif
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include <algorithm>
+
+NumaTopology &NumaTopology::instance()
+{
+    static NumaTopology topology;
+    return topology;
+}
+
+NumaTopology::NumaTopology()
+{
+#ifndef CONF_NO_HWLOC
+    if (hwloc_topology_init(&_topology) != 0)
+    {
+        _topology = nullptr;
+        return;
+    }
+    if (hwloc_topology_load(_topology) != 0)
+    {
+        hwloc_topology_destroy(_topology);
+        _topology = nullptr;
+        return;
+    }
+
+    const int nodes = hwloc_get_nbobjs_by_type(_topology, HWLOC_OBJ_NUMANODE);
+    _node_count = nodes > 0 ? static_cast<size_t>(nodes) : 1;
+
+    const int pus = hwloc_get_nbobjs_by_type(_topology, HWLOC_OBJ_PU);
+    for (int i = 0; i < pus; i++)
+    {
+        auto pu = hwloc_get_obj_by_type(_topology, HWLOC_OBJ_PU, static_cast<unsigned>(i));
+        if (_cpu_node.size() <= pu->os_index)
+        {
+            _cpu_node.resize(pu->os_index + 1, 0);
+        }
+
+        for (int n = 0; n < nodes; n++)
+        {
+            auto node = hwloc_get_obj_by_type(_topology, HWLOC_OBJ_NUMANODE, static_cast<unsigned>(n));
+            if (node->cpuset != nullptr && hwloc_bitmap_isset(node->cpuset, pu->os_index))
+            {
+                _cpu_node[pu->os_index] = static_cast<size_t>(n);
+                break;
+            }
+        }
+    }
+#endif
+}
+
+NumaTopology::~NumaTopology()
+{
+#ifndef CONF_NO_HWLOC
+    if (_topology != nullptr)
+    {
+        hwloc_topology_destroy(_topology);
+    }
+#endif
+}
+
+size_t NumaTopology::currentNode() const
+{
+    if (_node_count == 1)
+    {
+        return 0;
+    }
+
+    int cpu = -1;
+#if defined(__linux__)
+    cpu = sched_getcpu();
+#elif !defined(CONF_NO_HWLOC)
+    hwloc_bitmap_t set = hwloc_bitmap_alloc();
+    if (hwloc_get_last_cpu_location(_topology, set, HWLOC_CPUBIND_THREAD) == 0)
+    {
+        cpu = hwloc_bitmap_first(set);
+    }
+    hwloc_bitmap_free(set);
+#endif
+
+    if (cpu < 0 || static_cast<size_t>(cpu) >= _cpu_node.size())
+    {
+        return 0;
+    }
+    return _cpu_node[static_cast<size_t>(cpu)];
+}
+
+bool NumaTopology::bindMemory(void *addr, size_t len, size_t node) const
+{
+#ifndef CONF_NO_HWLOC
+    if (_topology == nullptr || node >= _node_count)
+    {
+        return false;
+    }
+
+    auto obj = hwloc_get_obj_by_type(_topology, HWLOC_OBJ_NUMANODE, static_cast<unsigned>(node));
+    if (obj == nullptr || obj->cpuset == nullptr)
+    {
+        return false;
+    }
+
+    return hwloc_set_area_membind(_topology, addr, len, obj->cpuset,
+                                  HWLOC_MEMBIND_BIND, HWLOC_MEMBIND_MIGRATE) == 0;
+#else
+    (void)addr;
+    (void)len;
+    (void)node;
+    return false;
+#endif
+}
+
+std::vector<unsigned> NumaTopology::minerCpus(bool smt, size_t bytesPerThread) const
+{
+    std::vector<unsigned> cpus;
+#ifndef CONF_NO_HWLOC
+    if (_topology == nullptr)
+    {
+        return cpus;
+    }
+
+    // the L3 domains, or the whole machine when the L3 is unknown
+    std::vector<hwloc_obj_t> domains;
+    const int l3_depth = hwloc_get_cache_type_depth(_topology, 3, HWLOC_OBJ_CACHE_UNIFIED);
+    if (l3_depth >= 0)
+    {
+        const unsigned count = hwloc_get_nbobjs_by_depth(_topology, static_cast<unsigned>(l3_depth));
+        for (unsigned i = 0; i < count; i++)
+        {
+            domains.push_back(hwloc_get_obj_by_depth(_topology, static_cast<unsigned>(l3_depth), i));
+        }
+    }
+    if (domains.empty())
+    {
+        domains.push_back(hwloc_get_root_obj(_topology));
+    }
+
+    std::vector<std::vector<unsigned>> domain_cpus;
+    for (auto domain : domains)
+    {
+        if (domain->cpuset == nullptr)
+        {
+            continue;
+        }
+
+        // first hardware thread of every core, then the second ones
+        std::vector<unsigned> first;
+        std::vector<unsigned> siblings;
+        hwloc_obj_t core = nullptr;
+        while ((core = hwloc_get_next_obj_inside_cpuset_by_type(_topology, domain->cpuset, HWLOC_OBJ_CORE, core)) != nullptr)
+        {
+            hwloc_obj_t pu = nullptr;
+            unsigned index = 0;
+            while ((pu = hwloc_get_next_obj_inside_cpuset_by_type(_topology, core->cpuset, HWLOC_OBJ_PU, pu)) != nullptr)
+            {
+                if (index == 0)
+                {
+                    first.push_back(pu->os_index);
+                }
+                else if (index == 1 && smt)
+                {
+                    siblings.push_back(pu->os_index);
+                }
+                index++;
+            }
+        }
+
+        // some platforms do not report cores, every hardware thread counts as one then
+        if (first.empty())
+        {
+            hwloc_obj_t pu = nullptr;
+            while ((pu = hwloc_get_next_obj_inside_cpuset_by_type(_topology, domain->cpuset, HWLOC_OBJ_PU, pu)) != nullptr)
+            {
+                first.push_back(pu->os_index);
+            }
+        }
+
+        first.insert(first.end(), siblings.begin(), siblings.end());
+
+        if (domain->type != HWLOC_OBJ_MACHINE && domain->attr != nullptr && bytesPerThread > 0)
+        {
+            const size_t fit = std::max<size_t>(1, domain->attr->cache.size / bytesPerThread);
+            if (first.size() > fit)
+            {
+                first.resize(fit);
+            }
+        }
+        domain_cpus.push_back(first);
+    }
+
+    // round robin over the domains, so fewer threads still spread over all L3s
+    for (size_t i = 0;; i++)
+    {
+        bool any = false;
+        for (const auto &domain : domain_cpus)
+        {
+            if (i < domain.size())
+            {
+                cpus.push_back(domain[i]);
+                any = true;
+            }
+        }
+        if (!any)
+        {
+            break;
+        }
+    }
+#else
+    (void)smt;
+    (void)bytesPerThread;
+#endif
+    return cpus;
+}
+
+bool NumaTopology::bindThread(int cpu) const
+{
+#ifndef CONF_NO_HWLOC
+    if (_topology == nullptr)
+    {
+        return false;
+    }
+
+    hwloc_bitmap_t set = hwloc_bitmap_dup(hwloc_get_root_obj(_topology)->cpuset);
+    if (cpu >= 0)
+    {
+        hwloc_bitmap_only(set, static_cast<unsigned>(cpu));
+    }
+    const bool bound = hwloc_set_cpubind(_topology, set, HWLOC_CPUBIND_THREAD) == 0;
+    hwloc_bitmap_free(set);
+    return bound;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
@@ -0,0 +1,74 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#ifndef QRYPTONIGHT_NUMATOPOLOGY_H
+#define QRYPTONIGHT_NUMATOPOLOGY_H
+
+#include <cstddef>
+#include <vector>
+
+struct hwloc_topology; // forward-declare this struct to keep hwloc.h out of the headers
+
+// NUMA layout of the host, read once through hwloc. Without hwloc
+// (CONF_NO_HWLOC) the host is treated as a single node
+class NumaTopology
+{
+public:
+    static NumaTopology &instance();
+
+    virtual ~NumaTopology();
+
+    NumaTopology(const NumaTopology &) = delete;
+    NumaTopology &operator=(const NumaTopology &) = delete;
+
+    size_t nodeCount() const { return _node_count; }
+
+    // node of the CPU the calling thread is running on
+    size_t currentNode() const;
+
+    // binds memory to node, migrating pages that were already touched.
+    // false if binding is not supported here
+    bool bindMemory(void *addr, size_t len, size_t node) const;
+
+    // OS cpu indices for miner threads, in the order to use them. Cores are
+    // taken round robin over the L3 domains, and each domain gets no more
+    // threads than its L3 holds bytesPerThread for. With smt the second
+    // hardware thread of each core follows once all first ones are used.
+    // Empty without hwloc
+    std::vector<unsigned> minerCpus(bool smt, size_t bytesPerThread) const;
+
+    // pins the calling thread to an OS cpu, or lets it run anywhere again
+    // for a negative cpu. false if pinning is not supported here
+    bool bindThread(int cpu) const;
+
+protected:
+    NumaTopology();
+
+    struct hwloc_topology *_topology = nullptr;
+    size_t _node_count = 1;
+
+    // NUMA node by OS cpu index
+    std::vector<size_t> _cpu_node;
+};
+
+#endif //QRYPTONIGHT_NUMATOPOLOGY_H
@@ -24,49 +24,108 @@
 #include "qryptominer.h"
 #include "qryptonight.h"
 #include "qryptonightpool.h"
+#include "forkhandlers.h"
+#include "numatopology.h"
 #include "pow/powhelper.h"
 #include <iostream>
 #include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <new>
 
 #ifndef _WIN32
 #include <netinet/in.h>
+#include <unistd.h>
 #else
 #include <winsock.h>
 #endif
 
 #define HASHRATE_MEASUREMENT_CYCLE 100
-#define HASHRATE_MEASUREMENT_FACTOR 10
+#define HASHRATE_EWMA_SECONDS 5.0
+#define HASHRATE_WINDOW_SECONDS 10.0
+#define HASHRATE_RECENT_SECONDS 1.0
 
-class ScopedCounter {
-public:
-    ScopedCounter(std::atomic<std::uint32_t>& counter)
-            :_counter(counter)
+std::shared_ptr<QryptonightPool> Qryptominer::_qnpool = QryptonightPool::hashers();
+
+namespace {
+    const size_t scratchpad_size = 2*1024*1024;
+
+    // the cpu the current worker thread is pinned to, -1 if it is not
+    thread_local int pinnedCpu = -1;
+
+    void placeWorker(uint32_t worker_idx, const std::vector<unsigned>& cpus)
     {
-        _counter++;
+        const int cpu = cpus.empty() ? -1 : static_cast<int>(cpus[worker_idx%cpus.size()]);
+        if (cpu!=pinnedCpu) {
+            NumaTopology::instance().bindThread(cpu);
+            pinnedCpu = cpu;
+        }
     }
-    ~ScopedCounter()
+
+    // slots of the event ring shares leave to the events that end a job
+    const size_t event_ring_reserved = 32;
+
+    // backoff of events handleEvent() did not accept
+    const std::chrono::milliseconds event_retry_min(1);
+    const std::chrono::milliseconds event_retry_max(100);
+
+    struct PendingEvent {
+        MinerEvent event;
+        std::chrono::milliseconds delay;
+        std::chrono::steady_clock::time_point due;
+    };
+
+    // Each interleaved lane needs its own 2 MB scratchpad. Pick the largest
+    // factor that still keeps every thread's scratchpads inside its share of L3
+    uint32_t autoInterleave(uint32_t thread_count)
     {
-        _counter--;
-    }
+        long l3_size = 0;
 
-    std::atomic<std::uint32_t>& _counter;
-};
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+        l3_size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
 
-std::shared_ptr<QryptonightPool> Qryptominer::_qnpool = std::make_shared<QryptonightPool>();
+        if (l3_size<=0 || thread_count==0)
+        {
+            return 1;
+        }
+
+        // activeBackend() makes sure the backend autotune has run
+        Qryptonight::activeBackend();
+        const uint32_t tuned = Qryptonight::tunedInterleave();
+        const size_t max_ways = tuned>0 ? tuned : QRYPTONIGHT_MAX_WAYS;
+
+        const size_t ways = static_cast<size_t>(l3_size)/(scratchpad_size*thread_count);
+        return static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(ways, max_ways)));
+    }
+}
 
 Qryptominer::Qryptominer()
 {
     _eventThread = std::make_unique<std::thread>([&]() { _eventThreadWorker(); });
-    _referenceTime = std::chrono::high_resolution_clock::now();
-    _deadline_enabled = false;
+    _timerThread = std::make_unique<std::thread>([&]() { _timerThreadWorker(); });
     _pause_milliseconds = 0;
+
+    _fork_handlers = ForkHandlers::instance().add({
+            ForkHandlers::PHASE_MINERS, nullptr, nullptr, [this]() { _childAfterFork(); }});
 }
 
 Qryptominer::~Qryptominer()
 {
+    ForkHandlers::instance().remove(_fork_handlers);
     cancel();
+    _stopWorkers();
+    {
+        std::lock_guard<std::mutex> timer_lock(_timer_mutex);
+        _stop_timerThread = true;
+        _timer_changed.notify_one();
+    }
+    _timerThread->join();
     {
-        std::lock_guard<std::mutex> queue_lock(_eventQueue_mutex);
+        std::lock_guard<std::mutex> wake_lock(_eventWake_mutex);
         _stop_eventThread = true;
         _eventReleased.notify_one();
     }
@@ -81,15 +140,18 @@ bool Qryptominer::solutionAvailable()
 
 bool Qryptominer::waitForAnswer(uint32_t timeoutSeconds)
 {
-    for (int i=0; i<timeoutSeconds; i++)
-    {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        if (solutionAvailable())
-        {
-            return true;
-        }
-    }
-    return false;
+    return _waitForAnswer(std::chrono::seconds(timeoutSeconds));
+}
+
+bool Qryptominer::waitForAnswerMilliseconds(uint32_t timeoutMilliseconds)
+{
+    return _waitForAnswer(std::chrono::milliseconds(timeoutMilliseconds));
+}
+
+bool Qryptominer::_waitForAnswer(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::recursive_timed_mutex> lock(_solution_mutex);
+    return _solution_ready.wait_for(lock, timeout, [this] { return _solution_found.load(); });
 }
 
 
@@ -103,7 +165,7 @@ uint32_t Qryptominer::solutionNonce()
 {
     std::lock_guard<std::recursive_timed_mutex> lock(_solution_mutex);
     auto p = _solution_input.data();
-    auto nonce = reinterpret_cast<uint32_t*>(p+_nonceOffset);
+    auto nonce = reinterpret_cast<uint32_t*>(p+_solution_nonce_offset);
     return ntohl(*nonce);
 }
 
@@ -115,142 +177,617 @@ std::vector<uint8_t> Qryptominer::solutionHash()
 
 uint32_t Qryptominer::hashRate()
 {
-    return static_cast<uint32_t>(_hash_per_sec);
-};
+    std::lock_guard<std::mutex> lock(_rates_mutex);
+    double rate = 0;
+    for (const auto& worker : _worker_hashes) {
+        rate += worker->rate;
+    }
+    return static_cast<uint32_t>(std::min<double>(rate, std::numeric_limits<uint32_t>::max()));
+}
+
+double Qryptominer::hashRateEwma()
+{
+    std::lock_guard<std::mutex> lock(_rates_mutex);
+    double rate = 0;
+    for (const auto& worker : _worker_hashes) {
+        rate += worker->ewma;
+    }
+    return rate;
+}
+
+double Qryptominer::hashRateWindow()
+{
+    std::lock_guard<std::mutex> lock(_rates_mutex);
+    double rate = 0;
+    for (const auto& worker : _worker_hashes) {
+        rate += worker->window;
+    }
+    return rate;
+}
+
+uint64_t Qryptominer::hashCount()
+{
+    std::lock_guard<std::mutex> lock(_rates_mutex);
+    uint64_t count = 0;
+    for (const auto& worker : _worker_hashes) {
+        count += worker->count.load(std::memory_order_relaxed)-worker->base;
+    }
+    return count;
+}
+
+std::vector<double> Qryptominer::threadHashRatesEwma()
+{
+    std::lock_guard<std::mutex> lock(_rates_mutex);
+    std::vector<double> rates;
+    for (const auto& worker : _worker_hashes) {
+        rates.push_back(worker->ewma);
+    }
+    return rates;
+}
+
+std::vector<double> Qryptominer::threadHashRatesWindow()
+{
+    std::lock_guard<std::mutex> lock(_rates_mutex);
+    std::vector<double> rates;
+    for (const auto& worker : _worker_hashes) {
+        rates.push_back(worker->window);
+    }
+    return rates;
+}
+
+void Qryptominer::_sampleHashRates()
+{
+    const auto now = std::chrono::steady_clock::now();
+    const auto window = std::chrono::duration<double>(HASHRATE_WINDOW_SECONDS);
+    const auto recent = std::chrono::duration<double>(HASHRATE_RECENT_SECONDS);
+
+    std::lock_guard<std::mutex> lock(_rates_mutex);
+    for (auto& worker : _worker_hashes) {
+        const uint64_t count = worker->count.load(std::memory_order_relaxed);
+        auto& samples = worker->samples;
+
+        if (!samples.empty()) {
+            const double elapsed = std::chrono::duration<double>(now-samples.back().first).count();
+            if (elapsed<=0) {
+                continue;
+            }
+            const double rate = (count-samples.back().second)/elapsed;
+
+            // the first rate seeds the average instead of ramping up from zero
+            const double alpha = 1-std::exp(-elapsed/HASHRATE_EWMA_SECONDS);
+            worker->ewma = samples.size()==1 ? rate : worker->ewma+alpha*(rate-worker->ewma);
+        }
+
+        samples.emplace_back(now, count);
+        while (samples.size()>2 && now-samples[1].first>=window) {
+            samples.pop_front();
+        }
+        if (samples.size()>1) {
+            // sampling is not in step with the passes, and a single cycle
+            // may fall inside a long pass, so the current rate spans a second
+            auto since = std::prev(samples.end(), 2);
+            while (since!=samples.begin() && now-std::prev(since)->first<=recent) {
+                --since;
+            }
+            worker->rate = (count-since->second)/std::chrono::duration<double>(now-since->first).count();
+
+            const double span = std::chrono::duration<double>(now-samples.front().first).count();
+            worker->window = (count-samples.front().second)/span;
+        }
+    }
+}
+
+void Qryptominer::_resetHashRates()
+{
+    std::lock_guard<std::mutex> lock(_rates_mutex);
+    for (auto& worker : _worker_hashes) {
+        worker->base = worker->count.load(std::memory_order_relaxed);
+        worker->rate = 0;
+        worker->ewma = 0;
+        worker->window = 0;
+        worker->samples.clear();
+    }
+}
 
 void Qryptominer::disableTimer()
 {
+    std::lock_guard<std::mutex> lock(_timer_mutex);
     _deadline_enabled = false;
+    _timer_changed.notify_one();
 }
 
 void Qryptominer::setTimer(uint32_t stopInMilliseconds)
 {
-    auto now = std::chrono::high_resolution_clock::now();
-    auto current_offset = std::chrono::duration_cast<std::chrono::milliseconds>(now-_referenceTime);
-
-    _deadline_milliseconds = current_offset.count()+stopInMilliseconds;
+    // both locks, so a start() cannot replace the job before its deadline is set
+    std::lock_guard<std::mutex> lock_job(_job_mutex);
+    std::lock_guard<std::mutex> lock(_timer_mutex);
+    _deadline = std::chrono::steady_clock::now()+std::chrono::milliseconds(stopInMilliseconds);
+    // without a job, _publishJob hands the deadline to the next one
+    _deadline_seq = _job ? _job->seq : 0;
     _deadline_enabled = true;
+    _timer_changed.notify_one();
 }
 
 uint32_t Qryptominer::getSecondsRemaining()
 {
-    auto now = std::chrono::high_resolution_clock::now();
-    auto current_offset = std::chrono::duration_cast<std::chrono::milliseconds>(now-_referenceTime);
-    auto remaining = _deadline_milliseconds.load()-current_offset.count();
+    std::lock_guard<std::mutex> lock(_timer_mutex);
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            _deadline-std::chrono::steady_clock::now()).count();
     if (remaining<=0)
         return 0;
     return (uint32_t) remaining;
 }
 
+void Qryptominer::_timerThreadWorker()
+{
+    const auto cycle = std::chrono::milliseconds(HASHRATE_MEASUREMENT_CYCLE);
+    auto nextSample = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(_timer_mutex);
+    while (!_stop_timerThread) {
+        const auto now = std::chrono::steady_clock::now();
+        const bool mining = _job_current!=nullptr;
+
+        if (_deadline_enabled && now>=_deadline) {
+            _deadline_enabled = false;
+            const uint64_t seq = _deadline_seq;
+            lock.unlock();
+            _expireJob(seq);
+            lock.lock();
+            continue;
+        }
+
+        if (mining && now>=nextSample) {
+            lock.unlock();
+            _sampleHashRates();
+            lock.lock();
+            nextSample = now+cycle;
+            continue;
+        }
+
+        // _publishJob wakes this up when a job arrives
+        auto wake = std::chrono::steady_clock::time_point::max();
+        if (mining) {
+            wake = nextSample;
+        }
+        if (_deadline_enabled) {
+            wake = std::min(wake, _deadline);
+        }
+        if (wake==std::chrono::steady_clock::time_point::max()) {
+            _timer_changed.wait(lock);
+        }
+        else {
+            _timer_changed.wait_until(lock, wake);
+        }
+    }
+}
+
+void Qryptominer::_expireJob(uint64_t seq)
+{
+    // the reference keeps the address from being reused until _endJob
+    std::shared_ptr<const Job> job;
+    {
+        std::lock_guard<std::mutex> lock(_job_mutex);
+        if (_job && _job->seq==seq) {
+            job = _job;
+        }
+    }
+    if (job && _endJob(job.get(), {TIMEOUT, seq})) {
+        _queueEvent({TIMEOUT, seq});
+    }
+}
+
 void Qryptominer::setForcedSleep(uint32_t pauseInMilliseconds)
 {
     _pause_milliseconds = pauseInMilliseconds;
 }
 
+void Qryptominer::setInterleave(uint32_t hashesPerThread)
+{
+    _interleave = std::min<uint32_t>(hashesPerThread, QRYPTONIGHT_MAX_WAYS);
+}
+
+uint32_t Qryptominer::interleave()
+{
+    return _interleave;
+}
+
+void Qryptominer::setPlacement(QryptominerPlacement placement)
+{
+    _placement = placement;
+}
+
+QryptominerPlacement Qryptominer::placement()
+{
+    return _placement;
+}
+
+void Qryptominer::setExtraNonce(size_t offset, uint32_t size)
+{
+    if (size>4) {
+        throw std::invalid_argument("extra nonce is limited to 4 bytes");
+    }
+    std::lock_guard<std::mutex> lock(_job_mutex);
+    _extra_offset = offset;
+    _extra_size = size;
+}
+
+void Qryptominer::setShareTarget(const std::vector<uint8_t>& shareTarget)
+{
+    if (!shareTarget.empty() && shareTarget.size()!=32) {
+        throw std::invalid_argument("share target must be 32 bytes");
+    }
+    std::lock_guard<std::mutex> lock(_job_mutex);
+    _share_target = shareTarget;
+}
+
+std::vector<uint8_t> Qryptominer::shareTarget()
+{
+    std::lock_guard<std::mutex> lock(_job_mutex);
+    return _share_target;
+}
+
+void Qryptominer::setNonceRange(uint64_t begin, uint64_t end)
+{
+    if (begin>end) {
+        throw std::invalid_argument("nonce range ends before it begins");
+    }
+    std::lock_guard<std::mutex> lock(_job_mutex);
+    _nonce_begin = begin;
+    _nonce_end = end;
+}
+
+uint64_t Qryptominer::nonceCursor()
+{
+    std::lock_guard<std::mutex> lock(_job_mutex);
+    if (_job) {
+        return std::min(_job->cursor.load(), _job->end);
+    }
+    return _nonce_cursor;
+}
+
 uint64_t Qryptominer::start(const std::vector<uint8_t>& input,
         size_t nonceOffset,
         const std::vector<uint8_t>& target,
         uint32_t thread_count)
 {
-    cancel();
+    auto job = std::make_shared<Job>();
+
+    const QryptominerPlacement placement = _placement;
+    if (placement!=QN_PLACE_NONE) {
+        // without an explicit interleave each thread needs at least one scratchpad in L3
+        const size_t lanes = _interleave>0 ? _interleave.load() : 1;
+        job->cpus = NumaTopology::instance().minerCpus(placement==QN_PLACE_SMT, lanes*scratchpad_size);
+    }
+
+    if (thread_count==0) {
+        thread_count = job->cpus.empty()
+                       ? std::thread::hardware_concurrency()
+                       : static_cast<uint32_t>(job->cpus.size());
+    }
+
+    job->input = input;
+    job->nonceOffset = nonceOffset;
+    job->target = target;
+    job->threads = thread_count;
+    job->ways = _interleave>0 ? _interleave.load() : autoInterleave(thread_count);
+
+    if (nonceOffset+sizeof(uint32_t)>input.size()) {
+        throw std::invalid_argument("nonce does not fit in the input");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock_job(_job_mutex);
+        job->shareTarget = _share_target;
+        job->extraOffset = _extra_offset;
+        job->extraSize = _extra_size;
+        job->cursor = _nonce_begin;
+        job->end = _nonce_end;
+    }
+
+    if (job->extraSize>0) {
+        if (job->extraOffset+job->extraSize>input.size()) {
+            throw std::invalid_argument("extra nonce does not fit in the input");
+        }
+        if (job->extraOffset<nonceOffset+sizeof(uint32_t) && nonceOffset<job->extraOffset+job->extraSize) {
+            throw std::invalid_argument("extra nonce overlaps the nonce");
+        }
+        for (uint32_t i = 0; i<job->extraSize; i++) {
+            job->extraBase = (job->extraBase << 8) | input[job->extraOffset+i];
+        }
+    }
+
+    // every value of the nonce, times every value of the extra nonce field
+    const uint64_t space = job->extraSize<4 ? uint64_t{1} << (32+8*job->extraSize)
+                                            : std::numeric_limits<uint64_t>::max();
+    job->end = std::min(job->end, space);
+
+    std::lock_guard<std::recursive_timed_mutex> lock_event(_event_mutex);
+    std::lock_guard<std::recursive_timed_mutex> lock_solution(_solution_mutex);
 
-    _input = input;
-    _nonceOffset = nonceOffset;
-    _target = target;
+    // the previous job ends here. Its workers are not joined, they move on
+    // to this job at their next nonce boundary
+    job->seq = ++_work_sequence_id;
+    _job_future = job->outcome.get_future().share();
 
-    _stop_request = false;
     _solution_found = false;
-    _hash_count = 0;
-    _hash_per_sec = 0;
+    _resetHashRates();
 
-    uint64_t current_work_sequence_id = _work_sequence_id.load();
+    _publishJob(std::move(job));
 
-    std::lock_guard<std::recursive_timed_mutex> lock_runningThreads(_runningThreads_mutex);
+    return _work_sequence_id;
+}
 
-    if (thread_count==0) {
-        thread_count = std::thread::hardware_concurrency();
+std::shared_future<MinerEvent> Qryptominer::startAsync(const std::vector<uint8_t>& input,
+        size_t nonceOffset,
+        const std::vector<uint8_t>& target,
+        uint32_t thread_count)
+{
+    // keeps another start() from replacing the future in between
+    std::lock_guard<std::recursive_timed_mutex> lock_event(_event_mutex);
+    start(input, nonceOffset, target, thread_count);
+
+    std::lock_guard<std::recursive_timed_mutex> lock_solution(_solution_mutex);
+    return _job_future;
+}
+
+void Qryptominer::_publishJob(std::shared_ptr<const Job> job)
+{
+    std::lock_guard<std::mutex> lock(_job_mutex);
+
+    const uint32_t threads = job ? job->threads : 0;
+    if (_job) {
+        // still current, so it ended without an outcome
+        _nonce_cursor = std::min(_job->cursor.load(), _job->end);
+        _job->outcome.set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
     }
+    _job = std::move(job);
+    _job_current = _job.get();
 
-    for (uint32_t thread_idx = 0; thread_idx<thread_count; thread_idx++) {
+    while (_runningThreads.size()<threads) {
+        const auto worker_idx = static_cast<uint32_t>(_runningThreads.size());
+        {
+            std::lock_guard<std::mutex> lock_rates(_rates_mutex);
+            _worker_hashes.emplace_back(std::make_unique<WorkerHashes>());
+        }
         _runningThreads.emplace_back(
-                std::make_unique<std::thread>([&]
-                        (uint32_t thread_idx, uint8_t thread_count, uint64_t current_work_sequence_id)
-                {
-                  ScopedCounter thread_counter(_runningThreads_count);
-
-                  auto qn = _qnpool->acquire();
-                  auto tmp_input(_input);
-                  auto p = tmp_input.data();
-                  auto nonce = reinterpret_cast<uint32_t*>(p+_nonceOffset);
-
-                  uint32_t current_nonce = thread_idx;
-
-                  auto hashrateReferenceTime = std::chrono::high_resolution_clock::now();
-                  std::chrono::high_resolution_clock::time_point threadTime;
-                  double drift = 0;
-
-                  while (!_stop_request && !_solution_found) {
-                      *nonce = htonl(current_nonce);
-                      auto current_hash = qn->hash(tmp_input);
-                      _hash_count++;
-
-                      if (thread_idx==0) {
-                          threadTime = std::chrono::high_resolution_clock::now();
-                          std::chrono::duration<double, std::milli> delta = threadTime-hashrateReferenceTime;
-                          if (delta.count()+drift>HASHRATE_MEASUREMENT_CYCLE) {
-                              drift = delta.count()+drift-HASHRATE_MEASUREMENT_CYCLE;
-                              hashrateReferenceTime = std::chrono::high_resolution_clock::now();
-                              _hash_per_sec = _hash_count*HASHRATE_MEASUREMENT_FACTOR;
-                              _hash_count = 0;
-                          }
-
-                          if (_deadline_enabled && getSecondsRemaining()==0) {
-                              _queueEvent({TIMEOUT, current_work_sequence_id});
-                              _stop_request = true;
-                              break;
-                          }
-                      }
-
-                      if (_pause_milliseconds>0)
-                      {
-                          std::this_thread::sleep_for(std::chrono::milliseconds(_pause_milliseconds));
-                      }
-
-                      if (PoWHelper::passesTarget(current_hash, _target)) {
-                          std::lock_guard<std::recursive_timed_mutex> lock_solution(_solution_mutex);
-                          if (!_solution_found) {
-                              _solution_found = true;
-                              _solution_input = tmp_input;
-                              _solution_hash = current_hash;
-                              _queueEvent({SOLUTION, current_work_sequence_id, current_nonce});
-                          }
-                      }
-
-                      current_nonce += thread_count;
-                  }
-                }, thread_idx, thread_count, current_work_sequence_id));
+                std::make_unique<std::thread>([this, worker_idx]() { _workerThread(worker_idx); }));
     }
+    _job_posted.notify_all();
 
-    return _work_sequence_id;
+    std::lock_guard<std::mutex> lock_timer(_timer_mutex);
+    if (_job && _deadline_enabled && _deadline_seq==0) {
+        _deadline_seq = _job->seq;
+    }
+    _timer_changed.notify_one();
 }
 
-void Qryptominer::_queueEvent(MinerEvent event)
+void Qryptominer::_workerThread(uint32_t worker_idx)
 {
-    std::lock_guard<std::mutex> lock_queue(_eventQueue_mutex);
-    _eventQueue.push_back(event);
-    _eventReleased.notify_one();
+    QryptonightPool::uniqueQryptonightPtr qn;
+
+    // the job this worker saw last. Holding on to it also keeps its address
+    // from being reused by a later job while the worker is parked
+    std::shared_ptr<const Job> job;
+
+    WorkerHashes* hashes;
+    {
+        std::lock_guard<std::mutex> lock_rates(_rates_mutex);
+        hashes = _worker_hashes[worker_idx].get();
+    }
+
+    std::unique_lock<std::mutex> lock(_job_mutex);
+    while (!_stop_workers) {
+        if (_job==job) {
+            if (qn) {
+                // hand the hasher back before parking. It stays in this
+                // thread's pool cache, so the next job usually gets the same
+                // warm instance back without going through the shared pool
+                lock.unlock();
+                qn.reset();
+                lock.lock();
+                continue;
+            }
+            _job_posted.wait(lock);
+            continue;
+        }
+
+        job = _job;
+        if (!job || worker_idx>=job->threads) {
+            continue;
+        }
+
+        _runningThreads_count++;
+        lock.unlock();
+
+        // placed before acquiring, so the pool hands out a hasher of the right node
+        placeWorker(worker_idx, job->cpus);
+
+        // the hasher budget may be used up, keep watching for a new job meanwhile
+        while (!qn && _job_current==job.get()) {
+            qn = _qnpool->acquireFor(std::chrono::milliseconds(100));
+        }
+        if (qn) {
+            job = _mine(worker_idx, std::move(job), *qn, hashes->count);
+        }
+
+        lock.lock();
+        if (--_runningThreads_count==0) {
+            _job_parked.notify_all();
+        }
+    }
 }
 
-void Qryptominer::cancel()
+std::shared_ptr<const Qryptominer::Job> Qryptominer::_mine(uint32_t worker_idx,
+        std::shared_ptr<const Job> job,
+        Qryptonight& qn,
+        std::atomic<std::uint64_t>& hash_count)
 {
-    std::lock_guard<std::recursive_timed_mutex> lock1(_event_mutex);
-    std::lock_guard<std::recursive_timed_mutex> lock2(_runningThreads_mutex);
-    _stop_request = true;
+    while (job && worker_idx<job->threads) {
+        const uint32_t ways = job->ways;
+
+        // one copy of the input per interleaved lane, back to back
+        const size_t input_size = job->input.size();
+        std::vector<uint8_t> tmp_input(input_size*ways);
+        for (uint32_t lane = 0; lane<ways; lane++) {
+            std::copy(job->input.begin(), job->input.end(), tmp_input.begin()+lane*input_size);
+        }
 
+        std::vector<uint8_t> current_hash(32*ways);
+        const bool valid_target = job->target.size()==32;
+        const bool valid_share_target = job->shareTarget.size()==32;
+
+        // checked once per pass, a new job is picked up at the next nonce boundary
+        while (_job_current==job.get() && !_solution_found) {
+            // the next few positions of the job's nonce space. The cursor
+            // never moves past the end, so it cannot wrap around
+            uint64_t first = job->cursor.load(std::memory_order_relaxed);
+            uint32_t lanes = 0;
+            do {
+                lanes = static_cast<uint32_t>(std::min<uint64_t>(ways, job->end-std::min(first, job->end)));
+            } while (lanes>0 && !job->cursor.compare_exchange_weak(first, first+lanes, std::memory_order_relaxed));
+
+            if (lanes==0) {
+                if (_endJob(job.get(), {NONCE_EXHAUSTED, job->seq})) {
+                    _queueEvent({NONCE_EXHAUSTED, job->seq});
+                }
+                break;
+            }
+
+            for (uint32_t lane = 0; lane<lanes; lane++) {
+                uint8_t* lane_input = tmp_input.data()+lane*input_size;
+                const uint64_t position = first+lane;
+                auto nonce = reinterpret_cast<uint32_t*>(lane_input+job->nonceOffset);
+                *nonce = htonl(static_cast<uint32_t>(position));
+
+                // big-endian, wrapping within the field
+                uint64_t extra = job->extraBase+(position >> 32);
+                for (uint32_t i = job->extraSize; i>0; i--) {
+                    lane_input[job->extraOffset+i-1] = static_cast<uint8_t>(extra);
+                    extra >>= 8;
+                }
+            }
+            qn.hashN(tmp_input.data(), input_size, current_hash.data(), lanes);
+            // only this worker writes its counter, no read-modify-write needed
+            hash_count.store(hash_count.load(std::memory_order_relaxed)+lanes, std::memory_order_relaxed);
+
+            if (_pause_milliseconds>0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(_pause_milliseconds));
+            }
+
+            bool found = false;
+            for (uint32_t lane = 0; lane<lanes; lane++) {
+                const uint8_t* lane_hash = current_hash.data()+lane*32;
+                const uint8_t* lane_input = tmp_input.data()+lane*input_size;
+
+                // shares are reported and mining goes on
+                if (valid_share_target && PoWHelper::passesTarget(lane_hash, job->shareTarget.data())
+                    && _job_current==job.get()) {
+                    _queueEvent({SHARE, job->seq, static_cast<uint32_t>(first+lane),
+                                 std::vector<uint8_t>(lane_hash, lane_hash+32),
+                                 std::vector<uint8_t>(lane_input, lane_input+input_size)});
+                }
+
+                if (valid_target && PoWHelper::passesTarget(lane_hash, job->target.data())) {
+                    std::lock_guard<std::recursive_timed_mutex> lock_solution(_solution_mutex);
+                    // a hash of a job that was replaced meanwhile is not a solution
+                    if (!_solution_found && _job_current==job.get()) {
+                        _solution_found = true;
+                        _solution_input.assign(tmp_input.begin()+lane*input_size,
+                                               tmp_input.begin()+(lane+1)*input_size);
+                        _solution_hash.assign(lane_hash, lane_hash+32);
+                        _solution_nonce_offset = job->nonceOffset;
+
+                        // ended before the lock is released, so that a start()
+                        // cannot replace the job between the two
+                        const MinerEvent solution{SOLUTION, job->seq, static_cast<uint32_t>(first+lane),
+                                                  _solution_hash, _solution_input};
+                        _endJob(job.get(), solution);
+                        _queueEvent(solution);
+                        _solution_ready.notify_all();
+                    }
+                    found = true;
+                    break;
+                }
+            }
+            if (found) {
+                break;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_job_mutex);
+            if (_job==job) {
+                // solved by another worker, which is about to end the job
+                break;
+            }
+            job = _job;
+        }
+        if (job && worker_idx<job->threads) {
+            placeWorker(worker_idx, job->cpus);
+        }
+    }
+    return job;
+}
+
+bool Qryptominer::_endJob(const Job* job, const MinerEvent& outcome)
+{
+    std::lock_guard<std::mutex> lock(_job_mutex);
+    if (_job.get()!=job) {
+        return false;
+    }
+    _job->outcome.set_value(outcome);
+    _nonce_cursor = std::min(_job->cursor.load(), _job->end);
+    _job.reset();
+    _job_current = nullptr;
+    return true;
+}
+
+void Qryptominer::_stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(_job_mutex);
+        _stop_workers = true;
+        _job_posted.notify_all();
+    }
     for (auto& t : _runningThreads) {
         t->join();
     }
     _runningThreads.clear();
+}
+
+void Qryptominer::_queueEvent(MinerEvent event)
+{
+    const size_t limit = event.type==SHARE ? _events.capacity()-event_ring_reserved : _events.capacity();
+    if (!_events.push(std::move(event), limit)) {
+        _dropped_events++;
+        return;
+    }
+
+    // pairs with the fence in _eventThreadWorker: either the event thread
+    // sees the event, or this sees it going to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_eventSleeping) {
+        std::lock_guard<std::mutex> wake_lock(_eventWake_mutex);
+        _eventReleased.notify_one();
+    }
+}
+
+uint64_t Qryptominer::droppedEvents()
+{
+    return _dropped_events;
+}
+
+void Qryptominer::cancel()
+{
+    std::lock_guard<std::recursive_timed_mutex> lock_event(_event_mutex);
+    {
+        // the workers stay, cancel only waits until all of them are parked
+        _publishJob(nullptr);
+        std::unique_lock<std::mutex> lock_job(_job_mutex);
+        _job_parked.wait(lock_job, [this] { return _runningThreads_count==0; });
+    }
     _work_sequence_id++;
 }
 
@@ -282,26 +819,94 @@ uint8_t Qryptominer::_sendEvent(MinerEvent event)
 
 void Qryptominer::_eventThreadWorker()
 {
+    // events handleEvent() did not accept yet, retried with backoff
+    std::deque<PendingEvent> pending;
+
+    auto dispatch = [&](MinerEvent&& event, std::chrono::milliseconds delay) {
+        if (event.seq!=_work_sequence_id || _sendEvent(event)) {
+            return;
+        }
+        delay = std::min(std::max(delay*2, event_retry_min), event_retry_max);
+        pending.push_back({std::move(event), delay, std::chrono::steady_clock::now()+delay});
+    };
+
     while (!_stop_eventThread) {
-        std::unique_lock<std::mutex> queue_lock(_eventQueue_mutex);
-        _eventReleased.wait(queue_lock,
-                [=] { return !_eventQueue.empty() || _stop_eventThread; });
-
-        if (!_eventQueue.empty()) {
-            auto event = _eventQueue.front();
-            _eventQueue.pop_front();
-            queue_lock.unlock();
-            if (event.seq==_work_sequence_id) {
-                if (!_sendEvent(event))
-                {
-                    // if event was not processed, put back in the queue and idle for 100ms
-                    _queueEvent(event);
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                }
+        // new events first, then retries that are due
+        MinerEvent event;
+        while (_events.pop(event)) {
+            dispatch(std::move(event), std::chrono::milliseconds(0));
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        for (size_t n = pending.size(); n>0; n--) {
+            auto retry = std::move(pending.front());
+            pending.pop_front();
+            if (retry.due>now) {
+                pending.push_back(std::move(retry));
+            }
+            else {
+                dispatch(std::move(retry.event), retry.delay);
             }
         }
+
+        std::unique_lock<std::mutex> wake_lock(_eventWake_mutex);
+        _eventSleeping = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        auto ready = [this] { return !_events.empty() || _stop_eventThread; };
+        if (pending.empty()) {
+            _eventReleased.wait(wake_lock, ready);
+        }
         else {
-            queue_lock.unlock();
+            auto due = pending.front().due;
+            for (const auto& retry : pending) {
+                due = std::min(due, retry.due);
+            }
+            _eventReleased.wait_until(wake_lock, due, ready);
         }
+        _eventSleeping = false;
     }
 }
+
+void Qryptominer::_childAfterFork()
+{
+    // the threads stayed in the parent, and may have held any of the locks
+    // or been halfway through the containers. Abandon all of them without
+    // running their destructors, joining a thread that is not there would
+    // never return
+    new (&_runningThreads) std::vector<std::unique_ptr<std::thread>>();
+    _events.reset();
+    new (&_solution_mutex) std::recursive_timed_mutex();
+    new (&_solution_ready) std::condition_variable_any();
+    new (&_job_future) std::shared_future<MinerEvent>();
+    new (&_event_mutex) std::recursive_timed_mutex();
+    new (&_job_mutex) std::mutex();
+    new (&_job_posted) std::condition_variable();
+    new (&_job_parked) std::condition_variable();
+    new (&_rates_mutex) std::mutex();
+    new (&_worker_hashes) std::vector<std::unique_ptr<WorkerHashes>>();
+    new (&_eventWake_mutex) std::mutex();
+    new (&_eventReleased) std::condition_variable();
+    new (&_timer_mutex) std::mutex();
+    new (&_timer_changed) std::condition_variable();
+    _eventSleeping = false;
+    _eventThread.release();
+    _timerThread.release();
+
+    // workers are spawned again by the next start()
+    new (&_job) std::shared_ptr<const Job>();
+    _runningThreads_count = 0;
+    _job_current = nullptr;
+    _stop_workers = false;
+    _stop_eventThread = false;
+    _stop_timerThread = false;
+
+    // events and deadlines of the parent's work are stale
+    _work_sequence_id++;
+    _deadline = std::chrono::steady_clock::time_point();
+    _deadline_seq = 0;
+    _deadline_enabled = false;
+
+    _eventThread = std::make_unique<std::thread>([&]() { _eventThreadWorker(); });
+    _timerThread = std::make_unique<std::thread>([&]() { _timerThreadWorker(); });
+}
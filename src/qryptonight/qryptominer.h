@@ -25,23 +25,45 @@
 #define QRYPTONIGHT_QRYPTOMINER_H
 
 #include <atomic>
+#include <chrono>
+#include <memory>
+#include <utility>
 #include <thread>
 #include <mutex>
 #include <future>
+#include <condition_variable>
 #include <deque>
+#include <limits>
 #include <vector>
 
+#ifndef SWIG
+// only the private event ring needs it, and swig cannot parse its alignas members
+#include "mpscring.h"
+#endif
+
+class Qryptonight;
 class QryptonightPool; // forward-declare this class to keep swig from including
 
 enum MinerEventType {
   SOLUTION = 0,
-  TIMEOUT = 1
+  TIMEOUT = 1,
+  NONCE_EXHAUSTED = 2,    // every nonce of the job's range has been handed out
+  SHARE = 3               // a hash under the share target, mining continues
+};
+
+// Where miner threads run
+enum QryptominerPlacement {
+  QN_PLACE_NONE = 0,    // unpinned, a thread_count of 0 means one thread per hardware thread
+  QN_PLACE_CORES = 1,   // pinned, one thread per physical core
+  QN_PLACE_SMT = 2      // pinned, up to two threads per physical core
 };
 
 struct MinerEvent {
   MinerEventType type;
   uint64_t seq;
   uint32_t nonce;
+  std::vector<uint8_t> hash;    // SHARE and SOLUTION only
+  std::vector<uint8_t> input;   // SHARE and SOLUTION only, the input that was hashed
 };
 
 class Qryptominer {
@@ -54,15 +76,71 @@ public:
             const std::vector<uint8_t>& target,
             uint32_t thread_count = 1);
 
+#ifndef SWIG
+    // start() for C++ callers that want to wait on the job itself. The
+    // future is ready when the job ends with SOLUTION, TIMEOUT or
+    // NONCE_EXHAUSTED, and holds that event. A job that is cancelled or
+    // replaced by another start() first fails with std::future_error
+    // (broken_promise)
+    std::shared_future<MinerEvent> startAsync(const std::vector<uint8_t>& input,
+            size_t nonceOffset,
+            const std::vector<uint8_t>& target,
+            uint32_t thread_count = 1);
+#endif
+
     uint64_t currentSequenceId() { return _work_sequence_id.load(); }
 
+    // The timer ends the job being mined, or the next one started if there
+    // is none, with TIMEOUT once the time is up. It fires once, setting it
+    // again moves the deadline. getSecondsRemaining() is in milliseconds
     void setTimer(uint32_t stopInMilliseconds);
     void disableTimer();
     uint32_t getSecondsRemaining();
 
     void setForcedSleep(uint32_t pauseInMilliseconds);
 
+    // Number of nonces each thread hashes in one interleaved pass (1..5).
+    // 0 selects a value based on the L3 cache available per thread
+    void setInterleave(uint32_t hashesPerThread);
+    uint32_t interleave();
+
+    // With a pinned placement a thread_count of 0 starts as many threads as
+    // the L3 caches hold scratchpads for, each pinned to its own hardware
+    // thread and spread over all L3 domains. Explicit thread counts are
+    // pinned in the same order. Takes effect at the next start()
+    void setPlacement(QryptominerPlacement placement);
+    QryptominerPlacement placement();
+
+    // Once all 2^32 values of the nonce are used, the extra nonce field of
+    // the input (1..4 bytes, big-endian, e.g. an extra nonce or a timestamp)
+    // is incremented and the nonce starts over. Size 0 disables rolling, the
+    // job then ends with NONCE_EXHAUSTED. Takes effect at the next start()
+    void setExtraNonce(size_t offset, uint32_t size);
+
+    // Share mode for pool mining. With a share target set, every hash under
+    // it raises a SHARE event with its nonce and hash, and the job goes on.
+    // The target given to start() remains the block target: a hash under it
+    // raises SOLUTION and ends the job as before. An empty share target
+    // turns share mode off. Takes effect at the next start()
+    void setShareTarget(const std::vector<uint8_t>& shareTarget);
+    std::vector<uint8_t> shareTarget();
+
+    // Positions in the nonce space are (extra nonce increments << 32) | nonce.
+    // Threads take consecutive positions from a shared cursor, so the space
+    // is covered in order without overlap. Jobs cover [begin, end), which
+    // allows giving several miners disjoint ranges, or resuming from
+    // nonceCursor(). Takes effect at the next start()
+    void setNonceRange(uint64_t begin, uint64_t end);
+
+    // next position to hand out, everything below it was handed out to a
+    // thread (the last pass of each thread may not have finished). Keeps the
+    // final position after the job ended
+    uint64_t nonceCursor();
+
+    // Block until a solution is available or the timeout passes. Wakes up
+    // as soon as a worker records the solution
     bool waitForAnswer(uint32_t timeoutSeconds);
+    bool waitForAnswerMilliseconds(uint32_t timeoutMilliseconds);
 
     void cancel();
     bool isRunning();
@@ -74,52 +152,170 @@ public:
     std::vector<uint8_t> solutionInput();
     std::vector<uint8_t> solutionHash();
     uint32_t solutionNonce();
+
+    // events lost because the event ring was full, see _queueEvent
+    uint64_t droppedEvents();
+
+    // Hashes per second. hashRate() is the rate of the last second,
+    // the EWMA is smoothed with a time constant of 5 s and the window rate
+    // averages the last 10 s. They are updated while a job is being mined;
+    // once it ends or cancel() stops it they keep their last values, and
+    // start() resets them to 0
     uint32_t hashRate();
+    double hashRateEwma();
+    double hashRateWindow();
+    uint64_t hashCount();     // hashes since start()
+
+    // the same for each worker thread. A worker that mined nothing since
+    // start() counts as 0
+    std::vector<double> threadHashRatesEwma();
+    std::vector<double> threadHashRatesWindow();
 
 protected:
     uint8_t _sendEvent(MinerEvent event);
+    bool _waitForAnswer(std::chrono::milliseconds timeout);
     void _queueEvent(MinerEvent event);
 
     void _eventThreadWorker();
 
-    std::vector<uint8_t> _input;
-    std::vector<uint8_t> _target;
-    size_t _nonceOffset{0};
+    // Keeps the time for the miner: ends jobs at their deadline and samples
+    // the hash rates while a job is mined, so workers only hash
+    void _timerThreadWorker();
+    void _expireJob(uint64_t seq);
+
+    // An immutable job. start() publishes a new one and workers switch to it
+    // at their next nonce boundary, without stopping
+    struct Job {
+        std::vector<uint8_t> input;
+        size_t nonceOffset{0};
+        std::vector<uint8_t> target;
+        std::vector<uint8_t> shareTarget;
+        uint64_t seq{0};
+        uint32_t threads{0};
+        uint32_t ways{1};
+        std::vector<unsigned> cpus;     // worker i runs on cpus[i % size], unpinned if empty
+
+        size_t extraOffset{0};
+        uint32_t extraSize{0};
+        uint64_t extraBase{0};          // value of the extra nonce field in input
+        uint64_t end{0};
+
+        // the mutable parts: the next position of the nonce space to hand
+        // out, and the outcome, settled once under _job_mutex
+        mutable std::atomic<std::uint64_t> cursor{0};
+        mutable std::promise<MinerEvent> outcome;
+    };
+
+    // Workers persist across jobs and park on _job_posted while there is no
+    // job for them
+    void _publishJob(std::shared_ptr<const Job> job);
+    void _workerThread(uint32_t worker_idx);
+    std::shared_ptr<const Job> _mine(uint32_t worker_idx,
+            std::shared_ptr<const Job> job,
+            Qryptonight& qn,
+            std::atomic<std::uint64_t>& hash_count);
+    // ends the job if it is still current and settles its outcome
+    bool _endJob(const Job* job, const MinerEvent& outcome);
+    void _stopWorkers();
+
+    // turns the worker counters into rates, called every measurement cycle
+    void _sampleHashRates();
+    void _resetHashRates();
+
+#ifndef SWIG
+    // Hash accounting of one worker. The counter is written by its worker
+    // only and has a cache line to itself; the rest belongs to the sampler
+    struct alignas(64) WorkerHashes {
+        std::atomic<std::uint64_t> count{0};
+
+        alignas(64) std::uint64_t base{0};      // count at start()
+        double rate{0};
+        double ewma{0};
+        double window{0};
+        std::deque<std::pair<std::chrono::steady_clock::time_point, std::uint64_t>> samples;
+    };
+#endif
+
+    // in a forked child, where only the forking thread exists: drops the
+    // miner, event and timer threads of the parent and starts new event
+    // and timer threads
+    void _childAfterFork();
 
     std::atomic<std::uint64_t> _work_sequence_id{0};
 
     std::vector<uint8_t> _solution_input;
     std::vector<uint8_t> _solution_hash;
+    size_t _solution_nonce_offset{0};
 
     std::atomic_bool _solution_found{false};
     std::atomic_bool _stop_eventThread{false};
-    std::atomic_bool _stop_request{false};
 
-    std::atomic<std::uint32_t> _hash_count{0};
-    std::atomic<std::uint32_t> _hash_per_sec{0};
+#ifndef SWIG
+    // one per worker, in the order of _runningThreads. Grown under
+    // _job_mutex and _rates_mutex, the sampler only needs the latter
+    std::vector<std::unique_ptr<WorkerHashes>> _worker_hashes;
+#endif
+    std::mutex _rates_mutex;
 
-    std::atomic<std::int32_t> _deadline_milliseconds;
-    std::atomic<bool> _deadline_enabled;
+    // deadline of the job with sequence id _deadline_seq, or of the next job
+    // published if it is 0. Under _timer_mutex
+    std::mutex _timer_mutex;
+    std::condition_variable _timer_changed;
+    std::chrono::steady_clock::time_point _deadline;
+    std::uint64_t _deadline_seq{0};
+    bool _deadline_enabled{false};
+    bool _stop_timerThread{false};
+    std::unique_ptr<std::thread> _timerThread;
 
     std::atomic<std::int32_t> _pause_milliseconds;
+    std::atomic<std::uint32_t> _interleave{0};
+    std::atomic<QryptominerPlacement> _placement{QN_PLACE_NONE};
 
     std::vector<std::unique_ptr<std::thread>> _runningThreads;
     std::atomic<std::uint32_t> _runningThreads_count{0};
 
+    // _job is owned under _job_mutex. _job_current publishes the same
+    // pointer for the per-pass check of the workers, which hold a reference
+    // to their job so the address cannot be reused underneath them
+    std::mutex _job_mutex;
+    std::condition_variable _job_posted;
+    std::condition_variable _job_parked;
+    std::shared_ptr<const Job> _job;
+    std::atomic<const Job*> _job_current{nullptr};
+    bool _stop_workers{false};
+
+    // settings of the next job, and the nonce cursor of the last one, under _job_mutex
+    std::vector<uint8_t> _share_target;
+    size_t _extra_offset{0};
+    std::uint32_t _extra_size{0};
+    std::uint64_t _nonce_begin{0};
+    std::uint64_t _nonce_end{std::numeric_limits<std::uint64_t>::max()};
+    std::uint64_t _nonce_cursor{0};
+
     std::recursive_timed_mutex _solution_mutex;
+    std::condition_variable_any _solution_ready;
     std::recursive_timed_mutex _event_mutex;
-    std::recursive_timed_mutex _runningThreads_mutex;
 
-    std::future<void> _solution_event;
+#ifndef SWIG
+    // outcome of the job of the last start(), under _solution_mutex
+    std::shared_future<MinerEvent> _job_future;
+#endif
     std::unique_ptr<std::thread> _eventThread;
 
-    std::deque<MinerEvent> _eventQueue;
-    std::mutex _eventQueue_mutex;
+#ifndef SWIG
+    // Workers queue events without locking. The event thread sleeps on
+    // _eventReleased only after announcing it in _eventSleeping, so
+    // producers take _eventWake_mutex only to wake it
+    MpscRing<MinerEvent, 256> _events;
+#endif
+    std::atomic_bool _eventSleeping{false};
+    std::mutex _eventWake_mutex;
     std::condition_variable _eventReleased;
-
-    std::chrono::high_resolution_clock::time_point _referenceTime;
+    std::atomic<std::uint64_t> _dropped_events{0};
 
     static std::shared_ptr<QryptonightPool> _qnpool;
+
+    size_t _fork_handlers;
 };
 
 #endif //QRYPTONIGHT_QRYPTOMINER_H
@@ -30,11 +30,44 @@
 #endif
 
 #include <iostream>
+#include <algorithm>
 #include "qryptonight.h"
+#include "numatopology.h"
+#include "qryptonightpool.h"
 
 #if defined(__linux__) || defined(__APPLE__)
 
-#include "hash-ops.h"
+#include "cnkernel.h"
+#include "cnbackend.h"
+#include "cnautotune.h"
+#include "scratchpadarena.h"
+
+static_assert(CN_MAX_WAYS==QRYPTONIGHT_MAX_WAYS, "interleave limits must match");
+
+#endif
+
+#if !defined(__linux__) && !defined(__APPLE__)
+
+namespace {
+    // xmr-stak scratchpads by page type, 4k and 2m
+    std::atomic<uint64_t> scratchpad_bytes[2];
+
+    void countScratchpad(cryptonight_ctx *ctx, bool allocated)
+    {
+        if (ctx != nullptr)
+        {
+            auto& bytes = scratchpad_bytes[ctx->ctx_info[0] ? 1 : 0];
+            if (allocated)
+            {
+                bytes.fetch_add(2*1024*1024);
+            }
+            else
+            {
+                bytes.fetch_sub(2*1024*1024);
+            }
+        }
+    }
+}
 
 #endif
 
@@ -53,16 +86,34 @@ Qryptonight::Qryptonight()
         // get context
         _context = cryptonight_alloc_ctx(1, 1, &_last_msg);
         if (_context!= nullptr)
+        {
+            countScratchpad(_context, true);
             return;
+        }
     }
 
     // If something failed.. go for basic settings
     init_res = cryptonight_init(0, 1, &_last_msg);
     _context = cryptonight_alloc_ctx(0, 1, &_last_msg);
-	
+    countScratchpad(_context, true);
+
+	#else
+
+    _context = cn_alloc_context(_last_error);
+
 	#endif
 }
 
+#if defined(__linux__) || defined(__APPLE__)
+
+Qryptonight::Qryptonight(std::shared_ptr<ScratchpadArena> arena)
+    : _arena(std::move(arena))
+{
+    _context = cn_alloc_context(_last_error, _arena);
+}
+
+#endif
+
 std::atomic_bool Qryptonight::_jconf_initialized { false };
 
 #if !defined(__linux__) && !defined(__APPLE__)
@@ -97,36 +148,377 @@ Qryptonight::~Qryptonight()
 	
     if (_context!= nullptr)
     {
+        countScratchpad(_context, false);
         cryptonight_free_ctx(_context);
     }
-	
+
+	#else
+
+    cn_free_context(_context);
+    for (auto ctx : _extra_contexts)
+    {
+        cn_free_context(ctx);
+    }
+
+	#endif
+}
+
+namespace {
+    void checkInput(size_t input_len)
+    {
+        // cryptonight hash does not support less than 43 bytes
+        const uint8_t minimum_input_size = 43;
+
+        if (input_len<minimum_input_size)
+        {
+            throw std::invalid_argument("input length should be > 42 bytes");
+        }
+    }
+}
+
+std::string Qryptonight::pageType()
+{
+    if (!isValid())
+    {
+        return "";
+    }
+
+	#if !defined(__linux__) && !defined(__APPLE__)
+
+    // xmr-stak flags contexts that got large pages
+    return _context->ctx_info[0] ? "2m" : "4k";
+
+	#else
+
+    return cn_page_type_name(_context->pages);
+
+	#endif
+}
+
+bool Qryptonight::bindToNode(size_t node)
+{
+    if (!isValid())
+    {
+        return false;
+    }
+
+    auto& topology = NumaTopology::instance();
+
+	#if !defined(__linux__) && !defined(__APPLE__)
+
+    // xmr-stak scratchpads are 2 MB
+    return topology.bindMemory(_context->long_state, 2*1024*1024, node);
+
+	#else
+
+    _numa_node = static_cast<int>(node);
+
+    bool bound = true;
+    for (auto ctx : _extra_contexts)
+    {
+        if (ctx!=nullptr && !ctx->arena)
+        {
+            bound = topology.bindMemory(ctx->long_state, CN_MEMORY, node) && bound;
+        }
+    }
+    if (!_context->arena)
+    {
+        bound = topology.bindMemory(_context->long_state, CN_MEMORY, node) && bound;
+    }
+    return bound;
+
+	#endif
+}
+
+void Qryptonight::prefault()
+{
+    if (!isValid())
+    {
+        return;
+    }
+
+	#if !defined(__linux__) && !defined(__APPLE__)
+
+    volatile uint8_t *state = _context->long_state;
+    for (size_t offset = 0; offset < 2*1024*1024; offset += 4096)
+    {
+        state[offset] = 0;
+    }
+
+	#else
+
+    cn_prefault_context(_context);
+    for (auto ctx : _extra_contexts)
+    {
+        if (ctx!=nullptr)
+        {
+            cn_prefault_context(ctx);
+        }
+    }
+
+	#endif
+}
+
+bool Qryptonight::discardScratchpads(bool lazy)
+{
+    if (!isValid())
+    {
+        return false;
+    }
+
+	#if !defined(__linux__) && !defined(__APPLE__)
+
+    // xmr-stak may have placed the scratchpad in large pages, keep it
+    return false;
+
+	#else
+
+    bool discarded = cn_discard_context(_context, lazy);
+    for (auto ctx : _extra_contexts)
+    {
+        if (ctx!=nullptr)
+        {
+            discarded = cn_discard_context(ctx, lazy) && discarded;
+        }
+    }
+    return discarded;
+
 	#endif
 }
 
 std::vector<uint8_t> Qryptonight::hash(const std::vector<uint8_t>& input)
 {
     std::vector<uint8_t> output(32);
+    hash(input.data(), input.size(), output.data());
+    return output;
+}
 
-    // cryptonight hash does not support less than 43 bytes
-    const uint8_t minimum_input_size = 43;
+void Qryptonight::hash(const uint8_t* input, size_t input_len, uint8_t* output)
+{
+    checkInput(input_len);
 
-    if (input.size()<minimum_input_size)
+    if (!isValid())
     {
-        throw std::invalid_argument("input length should be > 42 bytes");
+        throw std::runtime_error("cryptonight context not available: " + lastError());
     }
 
 	#if !defined(__linux__) && !defined(__APPLE__)
 	
-    _hash_fn(input.data(), input.size(),
-	    output.data(),
+    _hash_fn(input, input_len,
+	    output,
 	    _context);
 		
 	#else
 		
-	cn_slow_hash(input.data(), input.size(), (char*)output.data(), 1, 0, 0);
+	cn_hash(input, input_len, output, _context);
 	
 	#endif
+}
 
-    return output;
-};
+std::vector<std::vector<uint8_t>> Qryptonight::hashN(const std::vector<std::vector<uint8_t>>& inputs)
+{
+    std::vector<std::vector<uint8_t>> outputs;
+    if (inputs.empty())
+    {
+        return outputs;
+    }
+
+    const size_t input_len = inputs[0].size();
+    for (const auto& input : inputs)
+    {
+        if (input.size()!=input_len)
+        {
+            throw std::invalid_argument("all inputs should have the same length");
+        }
+    }
 
+    std::vector<uint8_t> input_buffer(input_len*QRYPTONIGHT_MAX_WAYS);
+    std::vector<uint8_t> output_buffer(32*QRYPTONIGHT_MAX_WAYS);
+
+    for (size_t first = 0; first<inputs.size(); first += QRYPTONIGHT_MAX_WAYS)
+    {
+        const size_t count = std::min<size_t>(QRYPTONIGHT_MAX_WAYS, inputs.size()-first);
+        for (size_t i = 0; i<count; i++)
+        {
+            std::copy(inputs[first+i].begin(), inputs[first+i].end(), input_buffer.begin()+i*input_len);
+        }
+
+        hashN(input_buffer.data(), input_len, output_buffer.data(), count);
+
+        for (size_t i = 0; i<count; i++)
+        {
+            outputs.emplace_back(output_buffer.begin()+i*32, output_buffer.begin()+(i+1)*32);
+        }
+    }
+
+    return outputs;
+}
+
+void Qryptonight::hashN(const uint8_t* input, size_t input_len, uint8_t* output, size_t count)
+{
+    if (count==0 || count>QRYPTONIGHT_MAX_WAYS)
+    {
+        throw std::invalid_argument("count should be between 1 and " + std::to_string(QRYPTONIGHT_MAX_WAYS));
+    }
+
+    checkInput(input_len);
+
+    if (!isValid())
+    {
+        throw std::runtime_error("cryptonight context not available: " + lastError());
+    }
+
+	#if !defined(__linux__) && !defined(__APPLE__)
+
+    for (size_t i = 0; i<count; i++)
+    {
+        _hash_fn(input+i*input_len, input_len, output+i*32, _context);
+    }
+
+	#else
+
+    cn_context *contexts[QRYPTONIGHT_MAX_WAYS] = { _context };
+    for (size_t i = 1; i<count; i++)
+    {
+        if (_extra_contexts[i-1]==nullptr)
+        {
+            _extra_contexts[i-1] = cn_alloc_context(_last_error, _arena);
+            if (_extra_contexts[i-1]==nullptr)
+            {
+                throw std::runtime_error("cryptonight context not available: " + _last_error);
+            }
+            if (_numa_node>=0 && !_extra_contexts[i-1]->arena)
+            {
+                NumaTopology::instance().bindMemory(_extra_contexts[i-1]->long_state, CN_MEMORY,
+                                                    static_cast<size_t>(_numa_node));
+            }
+        }
+        contexts[i] = _extra_contexts[i-1];
+    }
+
+    cn_hash_ways(input, input_len, output, contexts, count);
+
+	#endif
+}
+
+std::vector<std::string> Qryptonight::availableBackends()
+{
+	#if !defined(__linux__) && !defined(__APPLE__)
+
+    // xmr-stak picks its kernel once, from the jconf AES setting
+    return { "xmr-stak" };
+
+	#else
+
+    return CnBackendRegistry::instance().available();
+
+	#endif
+}
+
+bool Qryptonight::selectBackend(const std::string& name)
+{
+	#if !defined(__linux__) && !defined(__APPLE__)
+
+    return name == "xmr-stak";
+
+	#else
+
+    return CnBackendRegistry::instance().select(name);
+
+	#endif
+}
+
+std::string Qryptonight::activeBackend()
+{
+	#if !defined(__linux__) && !defined(__APPLE__)
+
+    return "xmr-stak";
+
+	#else
+
+    return CnBackendRegistry::instance().active().name;
+
+	#endif
+}
+
+std::string Qryptonight::autotune()
+{
+	#if !defined(__linux__) && !defined(__APPLE__)
+
+    return "xmr-stak";
+
+	#else
+
+    const auto result = CnAutotune::tune();
+    if (result.backend.empty())
+    {
+        return "";
+    }
+
+    const auto path = CnAutotune::cachePath();
+    if (!path.empty())
+    {
+        CnAutotune::storeCached(path, CnAutotune::cacheKey(), result);
+    }
+
+    CnBackendRegistry::instance().selectTuned(result.backend, result.ways);
+    return result.backend;
+
+	#endif
+}
+
+uint32_t Qryptonight::tunedInterleave()
+{
+	#if !defined(__linux__) && !defined(__APPLE__)
+
+    return 0;
+
+	#else
+
+    return CnBackendRegistry::instance().tunedWays();
+
+	#endif
+}
+
+void Qryptonight::setHasherBudget(size_t instances)
+{
+    auto hashers = QryptonightPool::hashers();
+    auto policy = hashers->policy();
+    policy.maxLive = instances>0 ? instances : std::numeric_limits<size_t>::max();
+    hashers->setPolicy(policy);
+}
+
+size_t Qryptonight::hasherBudget()
+{
+    const size_t maxLive = QryptonightPool::hashers()->policy().maxLive;
+    return maxLive==std::numeric_limits<size_t>::max() ? 0 : maxLive;
+}
+
+QryptonightPoolStats Qryptonight::hasherStats()
+{
+    return QryptonightPool::hashers()->stats();
+}
+
+uint64_t Qryptonight::scratchpadBytes(const std::string& pageType)
+{
+	#if !defined(__linux__) && !defined(__APPLE__)
+
+    if (pageType=="4k" || pageType=="2m")
+    {
+        return scratchpad_bytes[pageType=="2m" ? 1 : 0].load();
+    }
+    return 0;
+
+	#else
+
+    for (auto pages : {CN_PAGES_4K, CN_PAGES_THP, CN_PAGES_2M, CN_PAGES_1G})
+    {
+        if (pageType==cn_page_type_name(pages))
+        {
+            return cn_scratchpad_bytes(pages);
+        }
+    }
+    return 0;
+
+	#endif
+}
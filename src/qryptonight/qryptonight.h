@@ -25,13 +25,17 @@
 #define QRYPTONIGHT_QRYPTONIGHT_H
 
 #include <vector>
+#include <array>
 #include <string>
 #include <stdexcept>
 #include <atomic>
+#include <cstdint>
+#include <memory>
 
 #if defined(__linux__) || defined(__APPLE__)
 
-#include "hash-ops.h"
+struct cn_context; // forward-declare this struct to keep swig from including
+class ScratchpadArena;
 
 #else
 	
@@ -39,31 +43,122 @@
 
 #endif
 
+// Maximum number of inputs hashN computes in a single interleaved pass
+#define QRYPTONIGHT_MAX_WAYS 5
+
+// Counters of an instance pool, see Qryptonight::hasherStats()
+struct QryptonightPoolStats
+{
+    uint64_t hits = 0;              // acquires served by an idle instance
+    uint64_t misses = 0;            // acquires that had to create one
+    uint64_t live = 0;              // instances alive, idle or in use
+    uint64_t idle = 0;              // instances waiting in the pool
+    uint64_t created = 0;           // instances created so far, prewarmed ones included
+    uint64_t waits = 0;             // acquires that waited for the budget
+    uint64_t waitMicroseconds = 0;  // time spent in those waits
+
+    // scratchpad memory of every instance in the process, by page type.
+    // A shortfall in bytes2m or bytes1g means huge pages were not available
+    uint64_t bytes4k = 0;
+    uint64_t bytesThp = 0;          // transparent huge pages requested
+    uint64_t bytes2m = 0;
+    uint64_t bytes1g = 0;
+};
+
 class Qryptonight {
 public:
     Qryptonight();
+#if (defined(__linux__) || defined(__APPLE__)) && !defined(SWIG)
+    // Scratchpads are taken from arena while it has free slots
+    explicit Qryptonight(std::shared_ptr<ScratchpadArena> arena);
+#endif
     virtual ~Qryptonight();
 
-    bool isValid() { 		
-		#if defined(__linux__) || defined(__APPLE__)
-		return true;
-		#else
-		return _context != nullptr; 
-		#endif
-	}
-	
-	
+    bool isValid() { return _context != nullptr; }
+
     std::string lastError()	{ 
 		#if defined(__linux__) || defined(__APPLE__)
-		    return "";
+		    return _last_error;
 		#else
 		    return std::string(_last_msg.warning ? _last_msg.warning : ""); 
 		#endif
 	}
-	
+
+    // Pages backing the scratchpad: "4k", "thp" (transparent huge pages
+    // requested), "2m" or "1g". Empty if the instance is not valid
+    std::string pageType();
+
+#ifndef SWIG
+    // Instances own a scratchpad and must not be copied
+    Qryptonight(const Qryptonight&) = delete;
+    Qryptonight& operator=(const Qryptonight&) = delete;
+#endif
 
     std::vector<uint8_t> hash(const std::vector<uint8_t>& input);
 
+    // Hashes inputs of equal length, up to QRYPTONIGHT_MAX_WAYS at a time
+    std::vector<std::vector<uint8_t>> hashN(const std::vector<std::vector<uint8_t>>& inputs);
+
+#ifndef SWIG
+    // Allocation-free variants. The caller owns both buffers,
+    // output must have room for 32 bytes
+    void hash(const uint8_t* input, size_t input_len, uint8_t* output);
+    void hash(const uint8_t* input, size_t input_len, std::array<uint8_t, 32>& output)
+    {
+        hash(input, input_len, output.data());
+    }
+
+    // Hashes count (1..QRYPTONIGHT_MAX_WAYS) inputs of input_len bytes each,
+    // stored back to back, in one pass over interleaved scratchpads.
+    // output receives count consecutive 32-byte hashes
+    void hashN(const uint8_t* input, size_t input_len, uint8_t* output, size_t count);
+
+    // Keeps the scratchpads on a NUMA node (see NumaTopology), including
+    // the ones hashN allocates later. Scratchpads from an arena stay where
+    // the arena put them. Returns false if binding is not supported
+    bool bindToNode(size_t node);
+
+    // Faults the scratchpads in ahead of the first hash
+    void prefault();
+
+    // Returns the scratchpad pages to the kernel while keeping the instance
+    // usable, see cn_discard_context. False if not supported
+    bool discardScratchpads(bool lazy);
+#endif
+
+    // Hash kernels usable on this CPU, best first
+    static std::vector<std::string> availableBackends();
+
+    // Forces a kernel for every instance. Returns false if it is not available
+    static bool selectBackend(const std::string& name);
+
+    static std::string activeBackend();
+
+    // Self-tests and times every backend and interleave factor now, selects
+    // the fastest and caches the result for later processes. First use only
+    // does this by itself with QRYPTONIGHT_AUTOTUNE=1.
+    // Returns the selected backend, empty if none passed the self-test
+    static std::string autotune();
+
+    // Interleave factor the autotune found fastest, 0 if it did not run
+    static uint32_t tunedInterleave();
+
+    // Caps the instances PoWHelper and Qryptominer hash with, together.
+    // Each holds a 2 MB scratchpad per interleave lane. When all are busy,
+    // verifyInput waits for one and extra miner threads wait to start, so
+    // keep the budget above the miner thread count. 0 removes the cap
+    static void setHasherBudget(size_t instances);
+
+    // The cap set by setHasherBudget, 0 if there is none
+    static size_t hasherBudget();
+
+    // Counters of the instances PoWHelper and Qryptominer share
+    static QryptonightPoolStats hasherStats();
+
+    // Scratchpad memory of every instance in the process on pageType pages,
+    // see pageType()
+    static uint64_t scratchpadBytes(const std::string& pageType);
+
 protected:
 	#if !defined(__linux__) && !defined(__APPLE__)
     //Protected variables are prefixed with an underscore
@@ -74,7 +169,13 @@ protected:
     static void init();
     static std::atomic_bool _jconf_initialized;
 
-	#if !defined(__linux__) && !defined(__APPLE__)
+	#if defined(__linux__) || defined(__APPLE__)
+    std::string _last_error;
+    std::shared_ptr<ScratchpadArena> _arena;
+    cn_context *_context;
+    cn_context *_extra_contexts[QRYPTONIGHT_MAX_WAYS-1] = {};  // allocated on first use by hashN
+    int _numa_node = -1;
+	#else
     alloc_msg _last_msg = { nullptr };
     cryptonight_ctx *_context;
 	#endif
@@ -22,80 +22,1025 @@
   */
 
 #include "qryptonightpool.h"
+#include "numatopology.h"
+#include "forkhandlers.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <new>
+#include <vector>
 
-QryptonightPool::ReturnToPoolDeleter::ReturnToPoolDeleter(std::weak_ptr<QryptonightPool> ptrToOwnerPool)
-    : _ptrToOwnerPool(ptrToOwnerPool) { }
+namespace
+{
+    constexpr uint32_t NO_SLOT = 0xffffffff;
+
+    // slots are allocated in chunks that are never moved or freed while the
+    // pool state lives, so the freelists can follow them without a lock
+    constexpr size_t SLOTS_PER_CHUNK = 64;
+    constexpr size_t MAX_CHUNKS = 1024;
+
+    // freelist heads pack a slot index with a tag that changes on every
+    // update, so a head that was popped and pushed back (ABA) fails the CAS
+    inline uint32_t headSlot(uint64_t head) { return static_cast<uint32_t>(head); }
+    inline uint64_t nextHead(uint64_t head, uint32_t slot)
+    {
+        return (((head >> 32) + 1) << 32) | slot;
+    }
+}
+
+struct QryptonightPool::Shared
+{
+    struct Slot
+    {
+        Qryptonight* instance = nullptr;
+        size_t node = 0;
+        std::atomic<uint32_t> next{NO_SLOT};
+
+        std::chrono::steady_clock::time_point idleSince;
+        bool discarded = false;     // pages handed back to the kernel
+        uint32_t epoch = 0;         // Shared::epoch the instance was created in
+    };
+
+    struct FreeList
+    {
+        std::atomic<uint64_t> head{NO_SLOT};
+        std::atomic<size_t> count{0};
+    };
+
+    // the instance one thread released last. The owning thread puts
+    // instances in, and trim() puts back the fresh ones it took out. Both
+    // only fill an empty cell; anyone may take instances out
+    struct Cell
+    {
+        std::atomic<uint32_t> slot{NO_SLOT};
+        std::atomic<uint64_t> hits{0};      // written by the owning thread only
+    };
+
+    explicit Shared(QryptonightFactory factory);
+    ~Shared();
+
+    Slot& slot(uint32_t index);
+    uint32_t newSlot();
+
+    // creates an instance on node, returns its slot. NO_SLOT if maxLive
+    // instances are alive already
+    uint32_t create(size_t node);
+
+    // takes an idle instance from any node or thread cache
+    uint32_t steal();
+
+    // wakes the threads waiting for an instance, if there are any
+    void notifyWaiters();
+
+    // instances in the freelists
+    size_t freeCount() const;
+
+    void push(FreeList& list, uint32_t index);
+    uint32_t pop(FreeList& list);
+
+    // an idle instance of node, from its freelist or from the instances
+    // trim() holds aside
+    uint32_t popNode(size_t node);
+
+    void ref();
+    void unref();
+
+    // hand an instance back: thread cache first, then the freelist of its node
+    void release(uint32_t index);
+
+    // return a cached or released instance to the freelist of its node
+    void recycle(uint32_t index);
+
+    // delete an instance and recycle its slot
+    void destroy(uint32_t index);
+
+    // trim an idle instance; those it keeps are added to kept. Returns
+    // false if there was nothing to trim
+    bool trim(uint32_t index, QryptonightTrimMode mode, std::vector<uint32_t>& kept);
+
+    // delete every unused instance, used once the pool is gone
+    void drain();
+
+    // in a forked child: forget the instances of the parent
+    void resetAfterFork();
+
+    Cell* registerCell();
+    void unregisterCell(Cell* cell);
+
+    QryptonightFactory factory;
+
+    std::atomic<size_t> refs{1};
+    std::atomic<bool> closed{false};
+
+    // bumped in a forked child. Instances of an earlier epoch were created
+    // by the parent, they are deleted when released and not counted as live
+    uint32_t epoch = 0;
+
+    std::atomic<size_t> maxIdle{std::numeric_limits<size_t>::max()};
+    std::atomic<int> trimMode{QN_TRIM_DELETE};
+
+    std::atomic<size_t> maxLive{std::numeric_limits<size_t>::max()};
+    std::atomic<size_t> live{0};
+
+    // threads blocked in acquire() wait for generation to change
+    std::atomic<size_t> waiters{0};
+    std::mutex waitMutex;
+    std::condition_variable waitCv;
+    uint64_t generation = 0;
+
+    // telemetry, see QryptonightPoolStats. Hits on the thread caches are
+    // counted in the cells and added here when a cell goes away
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> created{0};
+    std::atomic<uint64_t> waits{0};
+    std::atomic<uint64_t> waitMicroseconds{0};
+
+    std::vector<std::unique_ptr<FreeList>> nodes;
+    // per node, the fresh instances trim() lifted off a freelist to get at
+    // the expired ones below them
+    std::vector<std::unique_ptr<FreeList>> aside;
+    FreeList spare;
+
+    std::array<std::atomic<Slot*>, MAX_CHUNKS> chunks;
+    std::atomic<uint32_t> slotCount{0};
+
+    mutable std::mutex cellsMutex;
+    std::vector<std::unique_ptr<Cell>> cells;
+};
+
+namespace
+{
+    // per-thread cells, one for every pool the thread released an instance to.
+    // Each entry holds a reference on the pool state
+    struct ThreadCache
+    {
+        struct Entry
+        {
+            QryptonightPool::Shared* shared;
+            QryptonightPool::Shared::Cell* cell;
+        };
+
+        ~ThreadCache();
+
+        QryptonightPool::Shared::Cell* find(QryptonightPool::Shared* shared, bool create);
+
+        std::vector<Entry> entries;
+    };
+
+    // trivially destructible, so it can be checked after the cache is gone
+    thread_local bool threadCacheDestroyed = false;
+    thread_local ThreadCache threadCache;
+
+    void dropEntry(const ThreadCache::Entry& entry)
+    {
+        const uint32_t index = entry.cell->slot.exchange(NO_SLOT);
+        if (index != NO_SLOT)
+        {
+            entry.shared->recycle(index);
+        }
+        entry.shared->unregisterCell(entry.cell);
+        entry.shared->unref();
+    }
+
+    ThreadCache::~ThreadCache()
+    {
+        threadCacheDestroyed = true;
+        for (const auto& entry : entries)
+        {
+            dropEntry(entry);
+        }
+    }
+
+    QryptonightPool::Shared::Cell* ThreadCache::find(QryptonightPool::Shared* shared, bool create)
+    {
+        QryptonightPool::Shared::Cell* found = nullptr;
+        for (size_t i = 0; i<entries.size(); )
+        {
+            if (entries[i].shared == shared)
+            {
+                found = entries[i].cell;
+                i++;
+            }
+            else if (entries[i].shared->closed.load())
+            {
+                // the pool is gone, let go of its state
+                auto entry = entries[i];
+                entries[i] = entries.back();
+                entries.pop_back();
+                dropEntry(entry);
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        if (found == nullptr && create)
+        {
+            found = shared->registerCell();
+            shared->ref();
+            entries.push_back({shared, found});
+        }
+        return found;
+    }
+
+    QryptonightPool::Shared::Cell* threadCell(QryptonightPool::Shared* shared, bool create)
+    {
+        if (threadCacheDestroyed)
+        {
+            return nullptr;
+        }
+        return threadCache.find(shared, create);
+    }
+}
+
+QryptonightPool::Shared::Shared(QryptonightFactory factory)
+    : factory(factory)
+{
+    const size_t nodeCount = NumaTopology::instance().nodeCount();
+    for (size_t node = 0; node<nodeCount; node++)
+    {
+        nodes.emplace_back(new FreeList());
+        aside.emplace_back(new FreeList());
+    }
+    for (auto& chunk : chunks)
+    {
+        chunk.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+QryptonightPool::Shared::~Shared()
+{
+    for (auto& chunk : chunks)
+    {
+        delete[] chunk.load(std::memory_order_relaxed);
+    }
+}
+
+QryptonightPool::Shared::Slot& QryptonightPool::Shared::slot(uint32_t index)
+{
+    return chunks[index / SLOTS_PER_CHUNK].load(std::memory_order_acquire)[index % SLOTS_PER_CHUNK];
+}
+
+uint32_t QryptonightPool::Shared::newSlot()
+{
+    uint32_t index = pop(spare);
+    if (index != NO_SLOT)
+    {
+        return index;
+    }
 
-void QryptonightPool::ReturnToPoolDeleter::operator()(Qryptonight* ptrToReleasedObject)
+    index = slotCount.fetch_add(1);
+    const size_t chunk = index / SLOTS_PER_CHUNK;
+    if (chunk >= MAX_CHUNKS)
+    {
+        throw std::bad_alloc();
+    }
+
+    if (chunks[chunk].load(std::memory_order_acquire) == nullptr)
+    {
+        Slot* fresh = new Slot[SLOTS_PER_CHUNK];
+        Slot* expected = nullptr;
+        if (!chunks[chunk].compare_exchange_strong(expected, fresh, std::memory_order_acq_rel))
+        {
+            // another thread installed the chunk first
+            delete[] fresh;
+        }
+    }
+    return index;
+}
+
+uint32_t QryptonightPool::Shared::create(size_t node)
+{
+    size_t current = live.load();
+    do
+    {
+        if (current >= maxLive.load())
+        {
+            return NO_SLOT;
+        }
+    }
+    while (!live.compare_exchange_weak(current, current + 1));
+
+    std::unique_ptr<Qryptonight> instance;
+    uint32_t index;
+    try
+    {
+        instance.reset(factory());
+        if (nodes.size()>1)
+        {
+            instance->bindToNode(node);
+        }
+        index = newSlot();
+    }
+    catch (...)
+    {
+        live.fetch_sub(1);
+        notifyWaiters();
+        throw;
+    }
+
+    Slot& fresh = slot(index);
+    fresh.instance = instance.release();
+    fresh.node = node;
+    fresh.discarded = false;
+    fresh.epoch = epoch;
+    created.fetch_add(1, std::memory_order_relaxed);
+    // every live instance keeps the pool state alive
+    ref();
+    return index;
+}
+
+size_t QryptonightPool::Shared::freeCount() const
+{
+    size_t count = 0;
+    for (size_t node = 0; node<nodes.size(); node++)
+    {
+        count += nodes[node]->count.load(std::memory_order_relaxed);
+        count += aside[node]->count.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+uint32_t QryptonightPool::Shared::steal()
 {
-    if (auto pool = _ptrToOwnerPool.lock())
+    for (size_t node = 0; node<nodes.size(); node++)
     {
-        // the pool still exists so attempt to return it back to the pool
-        try
+        const uint32_t index = popNode(node);
+        if (index != NO_SLOT)
         {
-            pool->add(uniqueQryptonightPtr{ptrToReleasedObject, ReturnToPoolDeleter(pool)});
+            return index;
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(cellsMutex);
+    for (auto& cell : cells)
+    {
+        const uint32_t index = cell->slot.exchange(NO_SLOT);
+        if (index != NO_SLOT)
+        {
+            return index;
+        }
+    }
+    return NO_SLOT;
+}
+
+void QryptonightPool::Shared::notifyWaiters()
+{
+    if (waiters.load() > 0)
+    {
+        std::unique_lock<std::mutex> lock(waitMutex);
+        generation++;
+        waitCv.notify_all();
+    }
+}
+
+void QryptonightPool::Shared::push(FreeList& list, uint32_t index)
+{
+    Slot& pushed = slot(index);
+    uint64_t head = list.head.load(std::memory_order_relaxed);
+    do
+    {
+        pushed.next.store(headSlot(head), std::memory_order_relaxed);
+    }
+    while (!list.head.compare_exchange_weak(head, nextHead(head, index)));
+    list.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t QryptonightPool::Shared::popNode(size_t node)
+{
+    const uint32_t index = pop(*nodes[node]);
+    return index != NO_SLOT ? index : pop(*aside[node]);
+}
+
+uint32_t QryptonightPool::Shared::pop(FreeList& list)
+{
+    uint64_t head = list.head.load(std::memory_order_acquire);
+    while (headSlot(head) != NO_SLOT)
+    {
+        const uint32_t next = slot(headSlot(head)).next.load(std::memory_order_relaxed);
+        if (list.head.compare_exchange_weak(head, nextHead(head, next), std::memory_order_acq_rel))
+        {
+            list.count.fetch_sub(1, std::memory_order_relaxed);
+            return headSlot(head);
+        }
+    }
+    return NO_SLOT;
+}
+
+void QryptonightPool::Shared::ref()
+{
+    refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void QryptonightPool::Shared::unref()
+{
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete this;
+    }
+}
+
+void QryptonightPool::Shared::release(uint32_t index)
+{
+    slot(index).idleSince = std::chrono::steady_clock::now();
+    if (closed.load() || maxIdle.load(std::memory_order_relaxed) == 0 || slot(index).epoch != epoch)
+    {
+        destroy(index);
+        return;
+    }
+
+    // trim() may have put an instance back meanwhile, claim the cell only if it is empty
+    Cell* cell = threadCell(this, true);
+    uint32_t empty = NO_SLOT;
+    if (cell != nullptr && cell->slot.compare_exchange_strong(empty, index))
+    {
+        // the pool may have closed and drained the cells in the meantime
+        if (closed.load())
+        {
+            drain();
             return;
         }
-        catch(const std::bad_alloc&) { }
+        notifyWaiters();
+        return;
     }
-    // the pool is gone or cannot be added back so delete the object
-    delete ptrToReleasedObject;
+    recycle(index);
 }
 
-void QryptonightPool::ReturnToPoolDeleter::detachFromPool()
+void QryptonightPool::Shared::recycle(uint32_t index)
 {
-    _ptrToOwnerPool.reset();
+    if (closed.load() || freeCount() >= maxIdle.load(std::memory_order_relaxed))
+    {
+        destroy(index);
+        return;
+    }
+
+    push(*nodes[slot(index).node], index);
+    // the pool may have closed and drained the freelists in the meantime
+    if (closed.load())
+    {
+        drain();
+        return;
+    }
+    notifyWaiters();
 }
 
-QryptonightPool::QryptonightPool(QryptonightFactory factory)
-    : _factory(factory)
-    , _mutex()
-    , _poolContainer()
+void QryptonightPool::Shared::destroy(uint32_t index)
 {
+    Slot& destroyed = slot(index);
+    delete destroyed.instance;
+    destroyed.instance = nullptr;
+    push(spare, index);
+
+    if (destroyed.epoch == epoch)
+    {
+        live.fetch_sub(1);
+    }
+    notifyWaiters();
+    unref();
 }
 
-QryptonightPool::~QryptonightPool()
+bool QryptonightPool::Shared::trim(uint32_t index, QryptonightTrimMode mode, std::vector<uint32_t>& kept)
 {
-    std::unique_lock<std::mutex> lock(_mutex);
-    while (!_poolContainer.empty())
+    Slot& idle = slot(index);
+    if (mode != QN_TRIM_DELETE)
     {
-        _poolContainer.top().get_deleter().detachFromPool();
-        _poolContainer.pop();
+        if (idle.discarded)
+        {
+            kept.push_back(index);
+            return false;
+        }
+        if (idle.instance->discardScratchpads(mode == QN_TRIM_FREE))
+        {
+            idle.discarded = true;
+            kept.push_back(index);
+            return true;
+        }
+        // the scratchpad cannot be discarded, delete it instead
     }
+    destroy(index);
+    return true;
+}
+
+void QryptonightPool::Shared::drain()
+{
+    // the last instance may drop the last reference before we are done
+    ref();
+    {
+        std::unique_lock<std::mutex> lock(cellsMutex);
+        for (auto& cell : cells)
+        {
+            const uint32_t index = cell->slot.exchange(NO_SLOT);
+            if (index != NO_SLOT)
+            {
+                destroy(index);
+            }
+        }
+    }
+    for (size_t node = 0; node<nodes.size(); node++)
+    {
+        uint32_t index;
+        while ((index = popNode(node)) != NO_SLOT)
+        {
+            destroy(index);
+        }
+    }
+    unref();
+}
+
+void QryptonightPool::Shared::resetAfterFork()
+{
+    epoch++;
+    live.store(0);
+    waiters.store(0);
+    generation = 0;
+
+    hits.store(0);
+    misses.store(0);
+    created.store(0);
+    waits.store(0);
+    waitMicroseconds.store(0);
+
+    std::vector<uint32_t> inherited;
+    for (auto& cell : cells)
+    {
+        const uint32_t index = cell->slot.exchange(NO_SLOT);
+        if (index != NO_SLOT)
+        {
+            inherited.push_back(index);
+        }
+        cell->hits.store(0);
+    }
+    for (size_t node = 0; node<nodes.size(); node++)
+    {
+        uint32_t index;
+        while ((index = popNode(node)) != NO_SLOT)
+        {
+            inherited.push_back(index);
+        }
+    }
+
+    // only the forking thread made it into the child, the other threads'
+    // caches will never hand back their cells and references
+    Cell* own = threadCell(this, false);
+    const size_t before = cells.size();
+    cells.erase(std::remove_if(cells.begin(), cells.end(),
+                               [own](const std::unique_ptr<Cell>& cell) { return cell.get() != own; }),
+                cells.end());
+    refs.fetch_sub(before - cells.size());
+
+    for (auto index : inherited)
+    {
+        destroy(index);
+    }
+}
+
+QryptonightPool::Shared::Cell* QryptonightPool::Shared::registerCell()
+{
+    std::unique_lock<std::mutex> lock(cellsMutex);
+    cells.emplace_back(new Cell());
+    return cells.back().get();
+}
+
+void QryptonightPool::Shared::unregisterCell(Cell* cell)
+{
+    std::unique_lock<std::mutex> lock(cellsMutex);
+    for (auto it = cells.begin(); it != cells.end(); ++it)
+    {
+        if (it->get() == cell)
+        {
+            hits.fetch_add(cell->hits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            cells.erase(it);
+            return;
+        }
+    }
+}
+
+QryptonightPool::ReturnToPoolDeleter::ReturnToPoolDeleter(Shared* shared, uint32_t slot)
+    : _shared(shared)
+    , _slot(slot) { }
+
+void QryptonightPool::ReturnToPoolDeleter::operator()(Qryptonight*)
+{
+    // the instance goes back to the pool, or is deleted if the pool is gone
+    _shared->release(_slot);
+}
+
+size_t QryptonightPool::ReturnToPoolDeleter::node() const
+{
+    return _shared->slot(_slot).node;
+}
+
+QryptonightPool::QryptonightPool(QryptonightFactory factory, QryptonightPoolPolicy policy)
+    : _shared(new Shared(factory))
+{
+    setPolicy(policy);
+
+    _fork_handlers = ForkHandlers::instance().add({
+            ForkHandlers::PHASE_POOLS,
+            [this]() { prepareFork(); },
+            [this]() { parentAfterFork(); },
+            [this]() { childAfterFork(); }});
+}
+
+#if defined(__linux__) || defined(__APPLE__)
+
+QryptonightPool::QryptonightFactory QryptonightPool::arenaFactory(std::shared_ptr<ScratchpadArena> arena)
+{
+    return [arena](){ return new Qryptonight(arena); };
+}
+
+#endif
+
+std::shared_ptr<QryptonightPool> QryptonightPool::hashers()
+{
+    static std::shared_ptr<QryptonightPool> pool = std::make_shared<QryptonightPool>();
+    return pool;
+}
+
+QryptonightPool::~QryptonightPool()
+{
+    ForkHandlers::instance().remove(_fork_handlers);
+    stopTrimmer();
+
+    // instances still in use are deleted when they are released
+    _shared->closed.store(true);
+    _shared->drain();
+    _shared->unref();
 }
 
 QryptonightPool::uniqueQryptonightPtr QryptonightPool::acquire()
 {
-    std::unique_lock<std::mutex> lock(_mutex);
-    if (_poolContainer.empty())
+    return acquireUntil(true, std::chrono::steady_clock::time_point::max());
+}
+
+QryptonightPool::uniqueQryptonightPtr QryptonightPool::acquireFor(std::chrono::milliseconds timeout)
+{
+    return acquireUntil(true, std::chrono::steady_clock::now() + timeout);
+}
+
+QryptonightPool::uniqueQryptonightPtr QryptonightPool::tryAcquire()
+{
+    return acquireUntil(false, std::chrono::steady_clock::time_point::max());
+}
+
+QryptonightPool::uniqueQryptonightPtr QryptonightPool::acquireUntil(bool wait, std::chrono::steady_clock::time_point deadline)
+{
+    const size_t node = NumaTopology::instance().currentNode() % _shared->nodes.size();
+
+    // the common case: the instance this thread released last
+    uint32_t index = NO_SLOT;
+    Shared::Cell* cell = threadCell(_shared, false);
+    if (cell != nullptr)
     {
-        // no Qryptonight intances availabe in the pool so use the factory to
-        // create and return a new one
-        return uniqueQryptonightPtr{_factory(), ReturnToPoolDeleter(shared_from_this())};
+        index = cell->slot.exchange(NO_SLOT);
+        if (index != NO_SLOT && _shared->slot(index).node != node)
+        {
+            // the thread moved to another node since
+            _shared->recycle(index);
+            index = NO_SLOT;
+        }
+        if (index != NO_SLOT)
+        {
+            cell->hits.store(cell->hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
     }
-    else
+
+    auto take = [this, node]()
     {
         // grab an unused Qryptonight instance from the pool
-        auto ptr = std::move(_poolContainer.top());
-        _poolContainer.pop();
-        return ptr;
+        uint32_t index = _shared->popNode(node);
+        if (index != NO_SLOT)
+        {
+            _shared->hits.fetch_add(1, std::memory_order_relaxed);
+            return index;
+        }
+
+        // no Qryptonight intances availabe on this node so use the factory
+        // to create a new one, unless the budget is used up
+        index = _shared->create(node);
+        if (index != NO_SLOT)
+        {
+            _shared->misses.fetch_add(1, std::memory_order_relaxed);
+            return index;
+        }
+
+        // the budget is used up, a remote instance beats waiting
+        index = _shared->steal();
+        if (index != NO_SLOT)
+        {
+            _shared->hits.fetch_add(1, std::memory_order_relaxed);
+        }
+        return index;
+    };
+
+    if (index == NO_SLOT)
+    {
+        index = take();
     }
+
+    if (index == NO_SLOT && wait)
+    {
+        const auto waitStart = std::chrono::steady_clock::now();
+        _shared->waiters.fetch_add(1);
+        while (index == NO_SLOT)
+        {
+            uint64_t generation;
+            {
+                std::unique_lock<std::mutex> lock(_shared->waitMutex);
+                generation = _shared->generation;
+            }
+
+            index = take();
+            if (index != NO_SLOT)
+            {
+                break;
+            }
+
+            // released or destroyed instances bump the generation
+            std::unique_lock<std::mutex> lock(_shared->waitMutex);
+            auto changed = [this, generation]() { return _shared->generation != generation; };
+            if (deadline == std::chrono::steady_clock::time_point::max())
+            {
+                _shared->waitCv.wait(lock, changed);
+            }
+            else if (!_shared->waitCv.wait_until(lock, deadline, changed))
+            {
+                break;
+            }
+        }
+        _shared->waiters.fetch_sub(1);
+
+        const auto waited = std::chrono::steady_clock::now() - waitStart;
+        _shared->waits.fetch_add(1, std::memory_order_relaxed);
+        _shared->waitMicroseconds.fetch_add(
+                std::chrono::duration_cast<std::chrono::microseconds>(waited).count(),
+                std::memory_order_relaxed);
+    }
+
+    if (index == NO_SLOT)
+    {
+        return uniqueQryptonightPtr{};
+    }
+
+    Shared::Slot& acquired = _shared->slot(index);
+    acquired.discarded = false;
+    return uniqueQryptonightPtr{acquired.instance, ReturnToPoolDeleter(_shared, index)};
+}
+
+size_t QryptonightPool::live() const
+{
+    return _shared->live.load();
 }
 
-void QryptonightPool::add(QryptonightPool::uniqueQryptonightPtr ptr)
+QryptonightPoolStats QryptonightPool::stats() const
 {
-    std::unique_lock<std::mutex> lock(_mutex);
-    _poolContainer.push(std::move(ptr));
+    QryptonightPoolStats stats;
+    stats.hits = _shared->hits.load(std::memory_order_relaxed);
+    {
+        std::unique_lock<std::mutex> lock(_shared->cellsMutex);
+        for (auto& cell : _shared->cells)
+        {
+            stats.hits += cell->hits.load(std::memory_order_relaxed);
+        }
+    }
+    stats.misses = _shared->misses.load(std::memory_order_relaxed);
+    stats.live = _shared->live.load();
+    stats.idle = size();
+    stats.created = _shared->created.load(std::memory_order_relaxed);
+    stats.waits = _shared->waits.load(std::memory_order_relaxed);
+    stats.waitMicroseconds = _shared->waitMicroseconds.load(std::memory_order_relaxed);
+
+    stats.bytes4k = Qryptonight::scratchpadBytes("4k");
+    stats.bytesThp = Qryptonight::scratchpadBytes("thp");
+    stats.bytes2m = Qryptonight::scratchpadBytes("2m");
+    stats.bytes1g = Qryptonight::scratchpadBytes("1g");
+    return stats;
 }
 
 bool QryptonightPool::empty() const
 {
-    std::unique_lock<std::mutex> lock(_mutex);
-    return _poolContainer.empty();
+    return size()==0;
 }
 
 size_t QryptonightPool::size() const
 {
-    std::unique_lock<std::mutex> lock(_mutex);
-    return _poolContainer.size();
+    size_t count = _shared->freeCount();
+
+    std::unique_lock<std::mutex> lock(_shared->cellsMutex);
+    for (auto& cell : _shared->cells)
+    {
+        if (cell->slot.load(std::memory_order_relaxed) != NO_SLOT)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+void QryptonightPool::reserve(size_t count)
+{
+    const size_t node = NumaTopology::instance().currentNode() % _shared->nodes.size();
+    while (size() < count && _shared->freeCount() < _shared->maxIdle.load())
+    {
+        const uint32_t index = _shared->create(node);
+        if (index == NO_SLOT)
+        {
+            // maxLive reached
+            break;
+        }
+        Shared::Slot& reserved = _shared->slot(index);
+        reserved.instance->prefault();
+        reserved.idleSince = std::chrono::steady_clock::now();
+        _shared->push(*_shared->nodes[node], index);
+        // acquire() may be waiting on maxLive, which this instance counts against
+        _shared->notifyWaiters();
+    }
+}
+
+size_t QryptonightPool::trim(std::chrono::milliseconds idleFor)
+{
+    const auto cutoff = std::chrono::steady_clock::now() - idleFor;
+    const auto mode = static_cast<QryptonightTrimMode>(_shared->trimMode.load());
+    size_t trimmed = 0;
+
+    // thread caches: put back what is still fresh, unless the owner
+    // cached another instance in the meantime
+    std::vector<uint32_t> stale;
+    {
+        std::unique_lock<std::mutex> lock(_shared->cellsMutex);
+        for (auto& cell : _shared->cells)
+        {
+            uint32_t index = cell->slot.exchange(NO_SLOT);
+            if (index == NO_SLOT)
+            {
+                continue;
+            }
+            if (_shared->slot(index).idleSince > cutoff)
+            {
+                uint32_t empty = NO_SLOT;
+                if (cell->slot.compare_exchange_strong(empty, index))
+                {
+                    _shared->notifyWaiters();
+                    continue;
+                }
+            }
+            stale.push_back(index);
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> kept(_shared->nodes.size());
+    for (auto index : stale)
+    {
+        auto& keptOnNode = kept[_shared->slot(index).node];
+        if (_shared->slot(index).idleSince > cutoff)
+        {
+            keptOnNode.push_back(index);
+        }
+        else if (_shared->trim(index, mode, keptOnNode))
+        {
+            trimmed++;
+        }
+    }
+
+    for (size_t node = 0; node<_shared->nodes.size(); node++)
+    {
+        Shared::FreeList& freeList = *_shared->nodes[node];
+        Shared::FreeList& aside = *_shared->aside[node];
+
+        // released instances go on top, so the expired ones are at the
+        // bottom. The fresh ones above them wait aside, where acquire()
+        // still finds them, and only expired ones are taken out
+        uint32_t index;
+        while ((index = _shared->pop(freeList)) != NO_SLOT)
+        {
+            if (_shared->slot(index).idleSince > cutoff)
+            {
+                _shared->push(aside, index);
+                _shared->notifyWaiters();
+            }
+            else if (_shared->trim(index, mode, kept[node]))
+            {
+                trimmed++;
+            }
+        }
+
+        // trimmed instances go to the bottom, so acquire() prefers warm ones.
+        // The fresh ones go back on top in their previous order
+        for (auto index : kept[node])
+        {
+            _shared->push(freeList, index);
+            _shared->notifyWaiters();
+        }
+        while ((index = _shared->pop(aside)) != NO_SLOT)
+        {
+            _shared->push(freeList, index);
+            _shared->notifyWaiters();
+        }
+    }
+    return trimmed;
+}
+
+QryptonightPoolPolicy QryptonightPool::policy() const
+{
+    QryptonightPoolPolicy current;
+    current.maxIdle = _shared->maxIdle.load();
+    current.trimMode = static_cast<QryptonightTrimMode>(_shared->trimMode.load());
+    current.maxLive = _shared->maxLive.load();
+
+    std::unique_lock<std::mutex> lock(_trim_mutex);
+    current.idleTimeout = _idle_timeout;
+    return current;
+}
+
+void QryptonightPool::setPolicy(const QryptonightPoolPolicy& policy)
+{
+    std::unique_lock<std::mutex> lock(_policy_mutex);
+
+    _shared->maxIdle.store(policy.maxIdle);
+    _shared->trimMode.store(policy.trimMode);
+    _shared->maxLive.store(policy.maxLive);
+    // a larger budget lets waiters create instances
+    _shared->notifyWaiters();
+
+    stopTrimmer();
+    {
+        std::unique_lock<std::mutex> trimLock(_trim_mutex);
+        _idle_timeout = policy.idleTimeout;
+    }
+    if (policy.idleTimeout.count() > 0)
+    {
+        startTrimmer();
+    }
+}
+
+void QryptonightPool::startTrimmer()
+{
+    _stop_trimmer = false;
+    _trimmer = std::thread([this]()
+    {
+        std::unique_lock<std::mutex> lock(_trim_mutex);
+        while (!_stop_trimmer)
+        {
+            // look twice per timeout, so nothing stays idle much longer
+            const auto timeout = _idle_timeout;
+            _trim_cv.wait_for(lock, std::max(timeout / 2, std::chrono::milliseconds(1)));
+            if (_stop_trimmer)
+            {
+                break;
+            }
+
+            lock.unlock();
+            trim(timeout);
+            lock.lock();
+        }
+    });
+}
+
+void QryptonightPool::stopTrimmer()
+{
+    {
+        std::unique_lock<std::mutex> lock(_trim_mutex);
+        _stop_trimmer = true;
+    }
+    _trim_cv.notify_all();
+    if (_trimmer.joinable())
+    {
+        _trimmer.join();
+    }
+}
+
+void QryptonightPool::prepareFork()
+{
+    _policy_mutex.lock();
+    _trim_mutex.lock();
+    _shared->cellsMutex.lock();
+    _shared->waitMutex.lock();
+}
+
+void QryptonightPool::parentAfterFork()
+{
+    _shared->waitMutex.unlock();
+    _shared->cellsMutex.unlock();
+    _trim_mutex.unlock();
+    _policy_mutex.unlock();
+}
+
+void QryptonightPool::childAfterFork()
+{
+    // waiters of these condition variables stayed in the parent
+    new (&_shared->waitCv) std::condition_variable();
+    new (&_trim_cv) std::condition_variable();
+    parentAfterFork();
+
+    // the trimmer thread stayed in the parent too, drop its handle unjoined
+    new (&_trimmer) std::thread();
+
+    _shared->resetAfterFork();
+
+    if (_idle_timeout.count() > 0)
+    {
+        startTrimmer();
+    }
 }
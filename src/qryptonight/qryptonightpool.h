@@ -25,62 +25,157 @@
 #define QRYPTONIGHT_QRYPTONIGHTPOOL_H
 
 #include "qryptonight.h"
-#include <mutex>
-#include <stack>
-#include <memory>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// How trimming gives the memory of an idle instance back
+enum QryptonightTrimMode
+{
+    QN_TRIM_DELETE,     // delete the instance with its scratchpad
+    QN_TRIM_DONTNEED,   // keep the instance, drop its pages now (MADV_DONTNEED)
+    QN_TRIM_FREE        // keep the instance, the kernel reclaims its pages when it needs them (MADV_FREE)
+};
 
-// An RAII-style object pool for memory-intensive Qryptonight objects
+struct QryptonightPoolPolicy
+{
+    // Idle instances kept in the shared freelists, further released
+    // instances are deleted. Each thread also caches the one it released last
+    size_t maxIdle = std::numeric_limits<size_t>::max();
+
+    // Instances idle for longer are trimmed by a background thread, zero
+    // disables it
+    std::chrono::milliseconds idleTimeout{0};
+
+    QryptonightTrimMode trimMode = QN_TRIM_DELETE;
+
+    // Instances alive at once, idle or in use. When all of them are busy,
+    // acquirers wait for one to be released. Each instance holds a 2 MB
+    // scratchpad per interleave lane it has hashed with
+    size_t maxLive = std::numeric_limits<size_t>::max();
+};
+
+// An RAII-style object pool for memory-intensive Qryptonight objects.
+// Instances are kept per NUMA node: acquire() hands out an instance whose
+// scratchpad is local to the node the calling thread runs on.
+// Each thread caches the instance it released last, so an acquire/release
+// pair on the same thread takes no lock. Behind the caches sits a lock-free
+// freelist per node. A child process after fork() starts with an empty pool
 // Warning! This class is not swig-compatible but does not need to be
 // exposed so make sure this class is not #included from a swig-included
 // header file
-class QryptonightPool : public std::enable_shared_from_this<QryptonightPool>
+class QryptonightPool
 {
 public:
 
     // a factory function to create new Qryptonight objects
     using QryptonightFactory = std::function<Qryptonight*()>;
 
-    QryptonightPool(QryptonightFactory factory = [](){ return new Qryptonight(); });
+    QryptonightPool(QryptonightFactory factory = [](){ return new Qryptonight(); },
+                    QryptonightPoolPolicy policy = QryptonightPoolPolicy());
+
+#if defined(__linux__) || defined(__APPLE__)
+    // a factory whose instances take their scratchpads from a shared arena
+    static QryptonightFactory arenaFactory(std::shared_ptr<ScratchpadArena> arena);
+#endif
 
     virtual ~QryptonightPool();
 
+    // the pool PoWHelper and Qryptominer share, so a single maxLive budget
+    // bounds the scratchpad memory of both
+    static std::shared_ptr<QryptonightPool> hashers();
+
+    QryptonightPool(const QryptonightPool &) = delete;
+    QryptonightPool &operator=(const QryptonightPool &) = delete;
+
+    // state shared by the pool, the thread caches and every instance the
+    // pool created. It outlives the pool until the last of them is gone
+    struct Shared;
+
     // helper functor to return pointers back to the pool
     // or delete the pointer if the pool no longer exists
     class ReturnToPoolDeleter
     {
     public:
-        explicit ReturnToPoolDeleter(std::weak_ptr<QryptonightPool> ptrToOwnerPool);
+        ReturnToPoolDeleter() = default;
+        ReturnToPoolDeleter(Shared* shared, uint32_t slot);
         void operator()(Qryptonight* ptrToReleasedObject);
-        void detachFromPool();
+        size_t node() const;
     private:
-        std::weak_ptr<QryptonightPool> _ptrToOwnerPool;
+        Shared* _shared = nullptr;
+        uint32_t _slot = 0;
     };
 
     // a std::unique_ptr with a custome deleter that the client will use
     using uniqueQryptonightPtr = std::unique_ptr<Qryptonight, ReturnToPoolDeleter>;
 
-    // obtain an unused Qryptonight instance from the pool or
-    // create a new one if there are none available
+    // obtain an unused Qryptonight instance local to the calling thread's
+    // NUMA node, or create a new one there if there are none available.
+    // With maxLive instances alive, an idle one from any node is taken, or
+    // the call blocks until one is released
     uniqueQryptonightPtr acquire();
 
+    // as acquire(), but gives up and returns nullptr after timeout
+    uniqueQryptonightPtr acquireFor(std::chrono::milliseconds timeout);
+
+    // as acquire(), but returns nullptr instead of blocking
+    uniqueQryptonightPtr tryAcquire();
+
     bool empty() const;
 
+    // instances alive, idle or in use
+    size_t live() const;
+
+    // counters since the pool was created. The scratchpad bytes cover
+    // every Qryptonight instance in the process
+    QryptonightPoolStats stats() const;
+
+    // unused instances, including those held in thread caches
     size_t size() const;
 
+    // creates instances on the calling thread's NUMA node and faults their
+    // scratchpads in, until count are unused or maxIdle or maxLive is reached
+    void reserve(size_t count);
+
+    // trims the unused instances that have been idle for at least idleFor,
+    // as the policy's trimMode says. Returns how many were trimmed
+    size_t trim(std::chrono::milliseconds idleFor = std::chrono::milliseconds(0));
+
+    QryptonightPoolPolicy policy() const;
+    void setPolicy(const QryptonightPoolPolicy& policy);
+
 protected:
 
-    // return the Qryptonight instance back to the pool
-    void add(uniqueQryptonightPtr ptr);
+    // shared by the acquire variants, waits for an instance until deadline
+    uniqueQryptonightPtr acquireUntil(bool wait, std::chrono::steady_clock::time_point deadline);
+
+    void startTrimmer();
+    void stopTrimmer();
+
+    // see ForkHandlers. The child starts with an empty pool: instances
+    // other threads were using are gone with them, idle ones are freed
+    void prepareFork();
+    void parentAfterFork();
+    void childAfterFork();
+
+    Shared* _shared;
 
-    // factory function to create the Qryptonight objects
-    QryptonightFactory _factory;
+    // serializes setPolicy
+    std::mutex _policy_mutex;
 
-    // allow mutually exclusive access to _poolContainer
-    mutable std::mutex _mutex;
+    // background trimming, running while the policy has an idleTimeout
+    mutable std::mutex _trim_mutex;
+    std::condition_variable _trim_cv;
+    std::chrono::milliseconds _idle_timeout{0};
+    bool _stop_trimmer = false;
+    std::thread _trimmer;
 
-    // container for the unused Qryptonight instances
-    std::stack<uniqueQryptonightPtr> _poolContainer;
+    size_t _fork_handlers;
 };
 
 #endif //QRYPTONIGHT_QRYPTONIGHTPOOL_H
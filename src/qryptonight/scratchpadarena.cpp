@@ -0,0 +1,208 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include "scratchpadarena.h"
+#include "numatopology.h"
+#include "forkhandlers.h"
+#include <sys/mman.h>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#if defined(__linux__)
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#endif
+
+namespace {
+    const size_t huge_page_1g = size_t(1) << 30;
+
+    size_t roundUp(size_t value, size_t multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+}
+
+bool thpEnabled()
+{
+#if defined(__linux__)
+    std::ifstream setting("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string value;
+    if (!std::getline(setting, value))
+    {
+        return false;
+    }
+    return value.find("[never]") == std::string::npos;
+#else
+    return false;
+#endif
+}
+
+ScratchpadArena::ScratchpadArena(const ScratchpadArenaConfig &config)
+    : _slots(config.slots)
+{
+    // nobody may hold the free list while the process forks. Memory locks
+    // are not inherited by the child
+    _fork_handlers = ForkHandlers::instance().add({
+            ForkHandlers::PHASE_ARENAS,
+            [this]() { _mutex.lock(); },
+            [this]() { _mutex.unlock(); },
+            [this]() { _mutex.unlock(); _locked = false; }});
+
+    if (_slots == 0)
+    {
+        _last_error = "scratchpad arena needs at least one slot";
+        return;
+    }
+
+    const size_t size = _slots * CN_MEMORY;
+
+#if defined(__linux__)
+    if (config.allow1G && map(roundUp(size, huge_page_1g), MAP_HUGETLB | MAP_HUGE_1GB))
+    {
+        _pages = CN_PAGES_1G;
+    }
+    else if (config.allow2M && map(size, MAP_HUGETLB | MAP_HUGE_2MB))
+    {
+        _pages = CN_PAGES_2M;
+    }
+    else if (map(size + CN_MEMORY, 0))
+    {
+        // trim the mapping to a 2 MB aligned region so THP can back it
+        auto aligned = reinterpret_cast<uint8_t *>(roundUp(reinterpret_cast<uintptr_t>(_base), CN_MEMORY));
+        const size_t head = static_cast<size_t>(aligned - _base);
+        if (head > 0)
+        {
+            munmap(_base, head);
+        }
+        munmap(aligned + size, CN_MEMORY - head);
+        _base = aligned;
+        _size = size;
+
+        madvise(_base, _size, MADV_HUGEPAGE);
+        _pages = thpEnabled() ? CN_PAGES_THP : CN_PAGES_4K;
+    }
+#else
+    if (map(size, 0))
+    {
+        _pages = CN_PAGES_4K;
+    }
+#endif
+
+    if (_base == nullptr)
+    {
+        _last_error = std::string("failed to map scratchpad arena: ") + strerror(errno);
+        return;
+    }
+
+    if (config.numaNode >= 0)
+    {
+        NumaTopology::instance().bindMemory(_base, _size, static_cast<size_t>(config.numaNode));
+    }
+
+    if (config.prefault)
+    {
+        for (size_t offset = 0; offset < _size; offset += 4096)
+        {
+            _base[offset] = 0;
+        }
+    }
+
+    if (config.lock)
+    {
+        _locked = mlock(_base, _size) == 0;
+        if (!_locked)
+        {
+            _last_error = std::string("failed to lock scratchpad arena: ") + strerror(errno);
+        }
+    }
+
+    _free.reserve(_slots);
+    for (size_t i = _slots; i > 0; i--)
+    {
+        _free.push_back(_base + (i - 1) * CN_MEMORY);
+    }
+}
+
+ScratchpadArena::~ScratchpadArena()
+{
+    ForkHandlers::instance().remove(_fork_handlers);
+
+    if (_base != nullptr)
+    {
+        if (_locked)
+        {
+            munlock(_base, _size);
+        }
+        munmap(_base, _size);
+    }
+}
+
+bool ScratchpadArena::map(size_t size, int flags)
+{
+    void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        return false;
+    }
+
+    _base = static_cast<uint8_t *>(mem);
+    _size = size;
+    return true;
+}
+
+size_t ScratchpadArena::freeSlots() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _free.size();
+}
+
+uint8_t *ScratchpadArena::acquire()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_free.empty())
+    {
+        return nullptr;
+    }
+
+    auto scratchpad = _free.back();
+    _free.pop_back();
+    return scratchpad;
+}
+
+void ScratchpadArena::release(uint8_t *scratchpad)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _free.push_back(scratchpad);
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#ifndef QRYPTONIGHT_SCRATCHPADARENA_H
+#define QRYPTONIGHT_SCRATCHPADARENA_H
+
+#include "cnkernel.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ScratchpadArenaConfig
+{
+    // number of CN_MEMORY scratchpads in the arena
+    size_t slots = 1;
+
+    // page sizes to try, largest first. Without them (or when the host has
+    // no huge pages reserved) the arena falls back to transparent huge pages.
+    // 1 GB pages are off by default: a small arena would round up to a whole
+    // gigabyte of them
+    bool allow1G = false;
+    bool allow2M = true;
+
+    // lock the arena in RAM. Failing to lock is reported but not fatal
+    bool lock = false;
+
+    // touch every page up front so hashing never takes a first-touch fault
+    bool prefault = true;
+
+    // NUMA node to place the arena on, -1 for wherever the kernel puts it
+    int numaNode = -1;
+};
+
+// One memory region, backed by the largest pages available, that is carved
+// into 2 MB aligned scratchpads. Share it between Qryptonight instances with
+// a std::shared_ptr; instances keep it alive while they use one of its slots
+class ScratchpadArena
+{
+public:
+    explicit ScratchpadArena(const ScratchpadArenaConfig &config = ScratchpadArenaConfig());
+    virtual ~ScratchpadArena();
+
+    ScratchpadArena(const ScratchpadArena &) = delete;
+    ScratchpadArena &operator=(const ScratchpadArena &) = delete;
+
+    bool isValid() const { return _base != nullptr; }
+    const std::string &lastError() const { return _last_error; }
+
+    cn_page_type pageType() const { return _pages; }
+    bool isLocked() const { return _locked; }
+
+    size_t slots() const { return _slots; }
+    size_t freeSlots() const;
+
+    // a free CN_MEMORY scratchpad, or nullptr if the arena is exhausted
+    uint8_t *acquire();
+    void release(uint8_t *scratchpad);
+
+protected:
+    bool map(size_t size, int flags);
+
+    uint8_t *_base = nullptr;
+    size_t _size = 0;
+    size_t _slots = 0;
+    cn_page_type _pages = CN_PAGES_4K;
+    bool _locked = false;
+    std::string _last_error;
+
+    mutable std::mutex _mutex;
+    std::vector<uint8_t *> _free;
+
+    size_t _fork_handlers;
+};
+
+// true unless transparent huge pages are disabled on this host
+bool thpEnabled();
+
+#endif //QRYPTONIGHT_SCRATCHPADARENA_H
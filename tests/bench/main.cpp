@@ -0,0 +1,54 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <vector>
+
+// Same as BENCHMARK_MAIN() but reports JSON unless another
+// --benchmark_format is given, so results can be compared across builds
+int main(int argc, char** argv)
+{
+    std::vector<char*> args(argv, argv + argc);
+
+    char json_format[] = "--benchmark_format=json";
+    bool has_format = false;
+    for (int i = 1; i < argc; i++)
+    {
+        has_format = has_format || strncmp(argv[i], "--benchmark_format", 18) == 0;
+    }
+    if (!has_format)
+    {
+        args.push_back(json_format);
+    }
+
+    int args_count = static_cast<int>(args.size());
+    benchmark::Initialize(&args_count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(args_count, args.data()))
+    {
+        return 1;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+#include <benchmark/benchmark.h>
+#include <pow/powhelper.h>
+#include <misc/bignum.h>
+
+namespace {
+    void BM_PassesTarget(benchmark::State& state)
+    {
+        std::vector<uint8_t> hash(32, 0x10);
+        std::vector<uint8_t> target(32, 0x20);
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(PoWHelper::passesTarget(hash.data(), target.data()));
+        }
+    }
+    BENCHMARK(BM_PassesTarget);
+
+    void BM_PassesTargetVector(benchmark::State& state)
+    {
+        std::vector<uint8_t> hash(32, 0x10);
+        std::vector<uint8_t> target(32, 0x20);
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(PoWHelper::passesTarget(hash, target));
+        }
+    }
+    BENCHMARK(BM_PassesTargetVector);
+
+    void BM_GetTarget(benchmark::State& state)
+    {
+        PoWHelper ph;
+        auto difficulty = toByteVector(static_cast<uint64_t>(state.range(0)));
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(ph.getTarget(difficulty));
+        }
+    }
+    BENCHMARK(BM_GetTarget)->Arg(2)->Arg(1000000);
+
+    void BM_GetDifficulty(benchmark::State& state)
+    {
+        PoWHelper ph;
+        auto parent_difficulty = toByteVector(1000000);
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(ph.getDifficulty(static_cast<uint64_t>(state.range(0)), parent_difficulty));
+        }
+    }
+    BENCHMARK(BM_GetDifficulty)->Arg(30)->Arg(60)->Arg(120);
+}
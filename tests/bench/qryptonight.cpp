@@ -0,0 +1,151 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+#include <algorithm>
+#include <thread>
+#include <benchmark/benchmark.h>
+#include <qryptonight/qryptonight.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <qryptonight/scratchpadarena.h>
+#endif
+
+namespace {
+    std::vector<uint8_t> makeInput(size_t size)
+    {
+        std::vector<uint8_t> input(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            input[i] = static_cast<uint8_t>(i * 7);
+        }
+        return input;
+    }
+
+    // Throughput (items_per_second) and latency (time per iteration) of a
+    // single hash, per input size and thread count. Every thread owns its
+    // scratchpad, like the miner threads do
+    void BM_Hash(benchmark::State& state)
+    {
+        Qryptonight qn;
+        auto input = makeInput(static_cast<size_t>(state.range(0)));
+        std::array<uint8_t, 32> output{};
+
+        for (auto _ : state)
+        {
+            qn.hash(input.data(), input.size(), output);
+            benchmark::DoNotOptimize(output);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+        state.SetLabel(Qryptonight::activeBackend() + " " + qn.pageType());
+    }
+    BENCHMARK(BM_Hash)
+        ->Arg(43)->Arg(76)->Arg(1000)->Arg(10000)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+    BENCHMARK(BM_Hash)
+        ->Arg(76)
+        ->ThreadRange(1, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())))
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+    // Interleaved hashing, state.range(0) inputs per pass
+    void BM_HashN(benchmark::State& state)
+    {
+        Qryptonight qn;
+        const size_t ways = static_cast<size_t>(state.range(0));
+        const size_t input_size = 76;
+        auto input = makeInput(input_size * ways);
+        std::vector<uint8_t> output(32 * ways);
+
+        for (auto _ : state)
+        {
+            qn.hashN(input.data(), input_size, output.data(), ways);
+            benchmark::DoNotOptimize(output.data());
+        }
+
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(ways));
+        state.SetLabel(Qryptonight::activeBackend());
+    }
+    BENCHMARK(BM_HashN)
+        ->DenseRange(1, QRYPTONIGHT_MAX_WAYS)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+    // Every backend usable on this host at every interleave factor
+    void BM_HashBackend(benchmark::State& state, const std::string& backend)
+    {
+        const auto previous = Qryptonight::activeBackend();
+        if (!Qryptonight::selectBackend(backend))
+        {
+            state.SkipWithError("backend not available");
+            return;
+        }
+
+        BM_HashN(state);
+
+        Qryptonight::selectBackend(previous);
+    }
+
+    const bool backends_registered = []() {
+        for (const auto& backend : Qryptonight::availableBackends())
+        {
+            benchmark::RegisterBenchmark(("BM_HashBackend/" + backend).c_str(), BM_HashBackend, backend)
+                ->DenseRange(1, QRYPTONIGHT_MAX_WAYS)
+                ->Unit(benchmark::kMillisecond)
+                ->UseRealTime();
+        }
+        return true;
+    }();
+
+#if defined(__linux__) || defined(__APPLE__)
+    // Scratchpads from a huge page arena (state.range(0) == 1) against
+    // regular allocations
+    void BM_HashPages(benchmark::State& state)
+    {
+        std::shared_ptr<ScratchpadArena> arena;
+        if (state.range(0))
+        {
+            ScratchpadArenaConfig config;
+            config.allow1G = false;
+            arena = std::make_shared<ScratchpadArena>(config);
+        }
+
+        Qryptonight qn(arena);
+        auto input = makeInput(76);
+        std::array<uint8_t, 32> output{};
+
+        for (auto _ : state)
+        {
+            qn.hash(input.data(), input.size(), output);
+            benchmark::DoNotOptimize(output);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+        state.SetLabel(qn.pageType());
+    }
+    BENCHMARK(BM_HashPages)
+        ->Arg(0)->Arg(1)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+#endif
+}
@@ -0,0 +1,154 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "gtest/gtest.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <qryptonight/cnautotune.h>
+#include "hash-ops.h"
+
+namespace {
+// keeps whatever tunes during the run out of the user's cache
+class TuneCacheEnvironment : public testing::Environment {
+public:
+  void SetUp() override {
+    setenv("QRYPTONIGHT_TUNE_CACHE", (testing::TempDir() + "qryptonight_test_autotune").c_str(), 1);
+  }
+};
+
+testing::Environment *const tune_cache_env = testing::AddGlobalTestEnvironment(new TuneCacheEnvironment);
+
+std::vector<CnKnownAnswer> referenceAnswers() {
+  std::vector<CnKnownAnswer> vectors(2);
+  vectors[0].input.assign(76, 0x21);
+  vectors[1].input.assign(300, 0x42);
+
+  for (auto &vector : vectors) {
+    vector.output.resize(32);
+    cn_slow_hash(vector.input.data(), vector.input.size(), reinterpret_cast<char *>(vector.output.data()), 1, 0, 0);
+  }
+  return vectors;
+}
+
+TEST(CnAutotune, SelfTestPassesWithCorrectAnswers) {
+  auto vectors = referenceAnswers();
+  auto &registry = CnBackendRegistry::instance();
+
+  for (const auto &name : registry.available()) {
+    EXPECT_TRUE(CnAutotune::selfTest(*registry.find(name), vectors)) << name;
+  }
+}
+
+TEST(CnAutotune, SelfTestRejectsWrongAnswers) {
+  auto vectors = referenceAnswers();
+  vectors[1].output[0] ^= 1;
+  auto &registry = CnBackendRegistry::instance();
+
+  for (const auto &name : registry.available()) {
+    EXPECT_FALSE(CnAutotune::selfTest(*registry.find(name), vectors)) << name;
+  }
+}
+
+TEST(CnAutotune, TunePicksAvailableBackend) {
+  auto result = CnAutotune::tune(referenceAnswers());
+  auto available = CnBackendRegistry::instance().available();
+
+  EXPECT_NE(std::find(available.begin(), available.end(), result.backend), available.end());
+  EXPECT_GE(result.ways, 1);
+  EXPECT_LE(result.ways, CN_MAX_WAYS);
+  EXPECT_GT(result.hashesPerSecond, 0);
+}
+
+TEST(CnAutotune, TuneWithoutPassingBackend) {
+  auto vectors = referenceAnswers();
+  vectors[0].output[31] ^= 1;
+
+  auto result = CnAutotune::tune(vectors);
+  EXPECT_TRUE(result.backend.empty());
+}
+
+TEST(CnAutotune, CacheRoundTrip) {
+  const std::string path = testing::TempDir() + "qryptonight_autotune_cache";
+  std::remove(path.c_str());
+
+  CnTuneResult result;
+  EXPECT_FALSE(CnAutotune::loadCached(path, "host a", result));
+
+  CnTuneResult stored;
+  stored.backend = "soft";
+  stored.ways = 3;
+  stored.hashesPerSecond = 12.5;
+  EXPECT_TRUE(CnAutotune::storeCached(path, "host a", stored));
+
+  stored.backend = "aesni";
+  EXPECT_TRUE(CnAutotune::storeCached(path, "host b", stored));
+
+  // replaces the existing entry for host a
+  stored.backend = "vaes256";
+  stored.ways = 2;
+  EXPECT_TRUE(CnAutotune::storeCached(path, "host a", stored));
+
+  ASSERT_TRUE(CnAutotune::loadCached(path, "host a", result));
+  EXPECT_EQ("vaes256", result.backend);
+  EXPECT_EQ(2, result.ways);
+  EXPECT_DOUBLE_EQ(12.5, result.hashesPerSecond);
+
+  ASSERT_TRUE(CnAutotune::loadCached(path, "host b", result));
+  EXPECT_EQ("aesni", result.backend);
+  EXPECT_FALSE(CnAutotune::loadCached(path, "host c", result));
+
+  std::remove(path.c_str());
+}
+
+TEST(CnAutotune, OptIn) {
+  const char *saved = std::getenv("QRYPTONIGHT_AUTOTUNE");
+  const std::string previous = saved != nullptr ? saved : "";
+
+  unsetenv("QRYPTONIGHT_AUTOTUNE");
+  EXPECT_FALSE(CnAutotune::enabled());
+  setenv("QRYPTONIGHT_AUTOTUNE", "0", 1);
+  EXPECT_FALSE(CnAutotune::enabled());
+  setenv("QRYPTONIGHT_AUTOTUNE", "1", 1);
+  EXPECT_TRUE(CnAutotune::enabled());
+
+  if (saved != nullptr) {
+    setenv("QRYPTONIGHT_AUTOTUNE", previous.c_str(), 1);
+  } else {
+    unsetenv("QRYPTONIGHT_AUTOTUNE");
+  }
+}
+
+TEST(CnAutotune, CachePathIsolatedInTests) {
+  EXPECT_EQ(testing::TempDir() + "qryptonight_test_autotune", CnAutotune::cachePath());
+}
+
+TEST(CnAutotune, CacheKeyNamesHost) {
+  auto key = CnAutotune::cacheKey();
+  EXPECT_NE(std::string::npos, key.find(getCpuBrand()));
+  EXPECT_EQ(std::string::npos, key.find('\t'));
+}
+}
+#endif
@@ -0,0 +1,51 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+#ifndef QRYPTONIGHT_TESTS_CNCONTEXTS_H
+#define QRYPTONIGHT_TESTS_CNCONTEXTS_H
+
+#include <string>
+#include <qryptonight/cnkernel.h>
+
+// One hashing context per interleave lane, for tests that call the kernels
+// directly
+class CnContexts {
+public:
+  CnContexts() {
+    std::string error;
+    for (auto &ctx : contexts) {
+      ctx = cn_alloc_context(error);
+    }
+  }
+  ~CnContexts() {
+    for (auto ctx : contexts) {
+      cn_free_context(ctx);
+    }
+  }
+
+  CnContexts(const CnContexts &) = delete;
+  CnContexts &operator=(const CnContexts &) = delete;
+
+  cn_context *contexts[CN_MAX_WAYS];
+};
+
+#endif //QRYPTONIGHT_TESTS_CNCONTEXTS_H
@@ -0,0 +1,102 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+#include <cstring>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <qryptonight/cnkeccak.h>
+#include <qryptonight/cpufeatures.h>
+#include "cncontexts.h"
+
+extern "C" {
+#include "keccak.h"
+}
+
+namespace {
+std::vector<uint8_t> makeInputs(size_t len, size_t count) {
+  std::vector<uint8_t> input(len * count);
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = static_cast<uint8_t>(i * 17 + len);
+  }
+  return input;
+}
+
+TEST(CnKeccak, BatchMatchesScalar) {
+  CnContexts ctx;
+
+  // around the 136 byte rate to cover the padding and multi-block paths
+  for (size_t len : {43, 76, 135, 136, 137, 300}) {
+    for (size_t count = 1; count <= CN_MAX_WAYS; count++) {
+      auto input = makeInputs(len, count);
+      cn_keccak1600_batch(input.data(), len, ctx.contexts, count);
+
+      for (size_t n = 0; n < count; n++) {
+        uint8_t expected[200];
+        keccak1600(input.data() + n * len, len, expected);
+        EXPECT_EQ(0, memcmp(expected, ctx.contexts[n]->hash_state, 200)) << "len " << len << " lane " << n;
+
+        keccakf(reinterpret_cast<uint64_t *>(expected), 24);
+        cn_keccakf_batch(ctx.contexts + n, 1);
+        EXPECT_EQ(0, memcmp(expected, ctx.contexts[n]->hash_state, 200)) << "len " << len << " lane " << n;
+      }
+
+      cn_keccakf_batch(ctx.contexts, count);
+      for (size_t n = 0; n < count; n++) {
+        uint8_t expected[200];
+        keccak1600(input.data() + n * len, len, expected);
+        keccakf(reinterpret_cast<uint64_t *>(expected), 24);
+        keccakf(reinterpret_cast<uint64_t *>(expected), 24);
+        EXPECT_EQ(0, memcmp(expected, ctx.contexts[n]->hash_state, 200)) << "len " << len << " lane " << n;
+      }
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+TEST(CnKeccak, Avx2MatchesScalar) {
+  if (!getCpuFeatures().avx2) {
+    GTEST_SKIP() << "AVX2 not supported";
+  }
+
+  CnContexts ctx;
+  const size_t len = 76;
+
+  for (size_t count = 1; count <= 4; count++) {
+    auto input = makeInputs(len, count);
+    cn_keccak1600_x4_avx2(input.data(), len, ctx.contexts, count);
+    cn_keccakf_x4_avx2(ctx.contexts, count);
+
+    for (size_t n = 0; n < count; n++) {
+      uint8_t expected[200];
+      keccak1600(input.data() + n * len, len, expected);
+      keccakf(reinterpret_cast<uint64_t *>(expected), 24);
+      EXPECT_EQ(0, memcmp(expected, ctx.contexts[n]->hash_state, 200)) << "lane " << n;
+    }
+  }
+}
+#endif
+
+}
+#endif
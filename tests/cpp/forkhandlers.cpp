@@ -0,0 +1,172 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <qryptonight/qryptonightpool.h>
+#include <qryptonight/qryptominer.h>
+#include <qryptonight/forkhandlers.h>
+#include "gtest/gtest.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+// Runs check in a forked child and returns its verdict. gtest assertions
+// would not reach the parent, so the child reports through its exit code
+bool inChild(const std::function<bool()> &check) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    _exit(check() ? 0 : 1);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+TEST(ForkHandlers, PhaseOrder) {
+  std::vector<int> calls;
+  auto &handlers = ForkHandlers::instance();
+  auto miners = handlers.add({ForkHandlers::PHASE_MINERS,
+                              [&]() { calls.push_back(3); }, [&]() { calls.push_back(-3); }, nullptr});
+  auto arenas = handlers.add({ForkHandlers::PHASE_ARENAS,
+                              [&]() { calls.push_back(1); }, [&]() { calls.push_back(-1); }, nullptr});
+
+  EXPECT_TRUE(inChild([]() { return true; }));
+  handlers.remove(miners);
+  handlers.remove(arenas);
+
+  // prepared last phase first, restored first phase first
+  EXPECT_EQ(std::vector<int>({3, 1, -1, -3}), calls);
+
+  calls.clear();
+  EXPECT_TRUE(inChild([]() { return true; }));
+  EXPECT_TRUE(calls.empty());
+}
+
+TEST(ForkHandlers, ChildStartsWithEmptyPool) {
+  auto pool = std::make_shared<QryptonightPool>();
+
+  // one idle instance in the freelist, one in another thread's cache and
+  // one in use by this thread
+  auto held = pool->acquire();
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool released = false;
+  bool forked = false;
+  std::thread worker([&]() {
+    pool->acquire().reset();
+    std::unique_lock<std::mutex> lock(mutex);
+    released = true;
+    cv.notify_all();
+    cv.wait(lock, [&]() { return forked; });
+  });
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() { return released; });
+  }
+
+  pool->reserve(2);
+  ASSERT_EQ(3, pool->live());
+
+  EXPECT_TRUE(inChild([&]() {
+    if (pool->size() != 0 || pool->live() != 0 || pool->stats().created != 0) {
+      return false;
+    }
+
+    // the inherited instance is deleted on release instead of pooled
+    held.reset();
+    if (pool->size() != 0) {
+      return false;
+    }
+
+    std::vector<uint8_t> input(76, 0x11);
+    auto qn = pool->acquire();
+    if (!qn->isValid() || qn->hash(input).size() != 32 || pool->live() != 1) {
+      return false;
+    }
+    qn.reset();
+    return pool->size() == 1;
+  }));
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    forked = true;
+    cv.notify_all();
+  }
+  worker.join();
+
+  // the parent is untouched
+  EXPECT_EQ(3, pool->live());
+  EXPECT_EQ(2, pool->size());
+}
+
+TEST(ForkHandlers, ChildRestartsTrimmer) {
+  QryptonightPoolPolicy policy;
+  policy.idleTimeout = std::chrono::milliseconds(20);
+  auto pool = std::make_shared<QryptonightPool>(QryptonightPool::QryptonightFactory(
+      []() { return new Qryptonight(); }), policy);
+
+  EXPECT_TRUE(inChild([&]() {
+    pool->acquire().reset();
+    for (int i = 0; i < 100 && !pool->empty(); i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return pool->empty();
+  }));
+}
+
+TEST(ForkHandlers, ChildMinerIsIdleAndUsable) {
+  Qryptominer qm;
+
+  // a target nothing meets, so the threads keep hashing through the fork
+  std::vector<uint8_t> input(80);
+  std::vector<uint8_t> target(32, 0);
+  qm.start(input, 0, target, 2);
+  while (!qm.isRunning()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  qm.setTimer(60000);
+
+  EXPECT_TRUE(inChild([&]() {
+    // the parent's deadline does not follow the child
+    if (qm.isRunning() || qm.runningThreadCount() != 0 || qm.getSecondsRemaining() != 0) {
+      return false;
+    }
+    qm.start(input, 0, target, 1);
+    for (int i = 0; i < 1000 && !qm.isRunning(); i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const bool running = qm.isRunning();
+    qm.cancel();
+    return running && !qm.isRunning();
+  }));
+
+  EXPECT_TRUE(qm.isRunning());
+  qm.cancel();
+}
+}
+#endif
@@ -0,0 +1,106 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+#include <thread>
+#include <vector>
+#include <qryptonight/mpscring.h>
+#include "gtest/gtest.h"
+
+namespace {
+TEST(MpscRing, Fifo) {
+  MpscRing<int, 8> ring;
+  EXPECT_TRUE(ring.empty());
+
+  for (int i = 0; i < 8; i++) {
+    EXPECT_TRUE(ring.push(int(i)));
+  }
+  EXPECT_FALSE(ring.push(8));
+
+  int value = -1;
+  for (int i = 0; i < 8; i++) {
+    ASSERT_TRUE(ring.pop(value));
+    EXPECT_EQ(i, value);
+  }
+  EXPECT_FALSE(ring.pop(value));
+  EXPECT_TRUE(ring.empty());
+}
+
+TEST(MpscRing, Limit) {
+  MpscRing<int, 8> ring;
+
+  // entries pushed with a limit leave the rest of the ring to the others
+  EXPECT_TRUE(ring.push(1, 2));
+  EXPECT_TRUE(ring.push(2, 2));
+  EXPECT_FALSE(ring.push(3, 2));
+  EXPECT_TRUE(ring.push(3));
+
+  int value;
+  ASSERT_TRUE(ring.pop(value));
+  EXPECT_TRUE(ring.push(4, 3));
+}
+
+TEST(MpscRing, MovesPayload) {
+  MpscRing<std::vector<int>, 4> ring;
+  std::vector<int> payload(100, 7);
+  ASSERT_TRUE(ring.push(std::move(payload)));
+
+  std::vector<int> value;
+  ASSERT_TRUE(ring.pop(value));
+  EXPECT_EQ(std::vector<int>(100, 7), value);
+}
+
+TEST(MpscRing, ConcurrentProducers) {
+  const int producers = 4;
+  const int per_producer = 20000;
+  MpscRing<std::pair<int, int>, 64> ring;
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([&ring, p]() {
+      for (int i = 0; i < per_producer; i++) {
+        while (!ring.push({p, i})) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  // every producer's entries arrive complete and in order
+  std::vector<int> next(producers, 0);
+  int received = 0;
+  while (received < producers * per_producer) {
+    std::pair<int, int> value;
+    if (!ring.pop(value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    ASSERT_EQ(next[value.first], value.second);
+    next[value.first]++;
+    received++;
+  }
+
+  for (auto &t : threads) {
+    t.join();
+  }
+  EXPECT_TRUE(ring.empty());
+}
+}
@@ -0,0 +1,126 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <qryptonight/numatopology.h>
+#include <qryptonight/qryptonightpool.h>
+#include "gtest/gtest.h"
+#include "hash-ops.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace {
+TEST(NumaTopology, Nodes) {
+  auto &topology = NumaTopology::instance();
+  EXPECT_GE(topology.nodeCount(), 1);
+  EXPECT_LT(topology.currentNode(), topology.nodeCount());
+}
+
+TEST(NumaTopology, BindMemory) {
+  auto &topology = NumaTopology::instance();
+  std::vector<uint8_t> buffer(1 << 16, 0x5a);
+
+  // binding may be unsupported, but must never damage the data
+  topology.bindMemory(buffer.data(), buffer.size(), topology.currentNode());
+  EXPECT_EQ(std::vector<uint8_t>(1 << 16, 0x5a), buffer);
+}
+
+TEST(NumaTopology, BoundQryptonightHashes) {
+  auto &topology = NumaTopology::instance();
+
+  std::vector<uint8_t> input(76, 0x42);
+  std::vector<uint8_t> output_expected(32);
+  cn_slow_hash(input.data(), input.size(), reinterpret_cast<char *>(output_expected.data()), 1, 0, 0);
+
+  Qryptonight qn;
+  ASSERT_TRUE(qn.isValid());
+  qn.bindToNode(topology.nodeCount() - 1);
+  EXPECT_EQ(output_expected, qn.hash(input));
+
+  // extra interleave lanes are allocated on the bound node as well
+  auto outputs = qn.hashN({input, input});
+  for (const auto &output : outputs) {
+    EXPECT_EQ(output_expected, output);
+  }
+}
+
+TEST(NumaTopology, PoolReturnsToAcquiringNode) {
+  auto pool = std::make_shared<QryptonightPool>();
+
+  Qryptonight *raw;
+  {
+    auto qn = pool->acquire();
+    raw = qn.get();
+    EXPECT_LT(qn.get_deleter().node(), NumaTopology::instance().nodeCount());
+  }
+  EXPECT_EQ(1, pool->size());
+
+  // with a single node the released instance is handed out again
+  if (NumaTopology::instance().nodeCount() == 1) {
+    auto qn = pool->acquire();
+    EXPECT_EQ(raw, qn.get());
+    EXPECT_TRUE(pool->empty());
+  }
+}
+
+TEST(NumaTopology, MinerCpus) {
+  auto &topology = NumaTopology::instance();
+
+  auto cores = topology.minerCpus(false, 2 * 1024 * 1024);
+  auto threads = topology.minerCpus(true, 2 * 1024 * 1024);
+  EXPECT_GE(threads.size(), cores.size());
+
+  // no cpu is handed out twice
+  auto unique = threads;
+  std::sort(unique.begin(), unique.end());
+  EXPECT_EQ(unique.end(), std::unique(unique.begin(), unique.end()));
+
+  // an L3 too small for even one thread still gets one
+  auto capped = topology.minerCpus(false, static_cast<size_t>(1) << 50);
+  EXPECT_LE(capped.size(), cores.size());
+  if (!cores.empty()) {
+    EXPECT_GE(capped.size(), 1);
+    EXPECT_EQ(cores[0], capped[0]);
+  }
+}
+
+TEST(NumaTopology, BindThread) {
+  auto &topology = NumaTopology::instance();
+  auto cpus = topology.minerCpus(false, 0);
+  if (cpus.empty()) {
+    return;
+  }
+
+  std::thread([&]() {
+    ASSERT_TRUE(topology.bindThread(static_cast<int>(cpus.back())));
+#if defined(__linux__)
+    EXPECT_EQ(static_cast<int>(cpus.back()), sched_getcpu());
+#endif
+    EXPECT_TRUE(topology.bindThread(-1));
+  }).join();
+}
+}
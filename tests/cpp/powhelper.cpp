@@ -21,7 +21,10 @@
   *
   */
 #include <iostream>
+#include <future>
 #include <qryptonight/qryptominer.h>
+#include <qryptonight/qryptonight.h>
+#include <qryptonight/qryptonightpool.h>
 #include <pow/powhelper.h>
 #include <misc/bignum.h>
 #include "gtest/gtest.h"
@@ -219,4 +222,53 @@ namespace {
         EXPECT_EQ(951172, fromByteVector(difficulty));
     }
 
+    TEST(PoWHelper, PassesTargetRawBuffers) {
+        std::vector<uint8_t> target{
+                0x3E, 0xE5, 0x3F, 0xE1, 0xAC, 0xF3, 0x55, 0x92,
+                0x66, 0xD8, 0x43, 0x89, 0xCE, 0xDE, 0x99, 0x33,
+                0xC6, 0x8F, 0xC5, 0x1E, 0xD0, 0xA6, 0xC7, 0x91,
+                0xF8, 0xF9, 0xE8, 0x9D, 0xB6, 0x23, 0xF0, 0xF6
+        };
+
+        EXPECT_TRUE(PoWHelper::passesTarget(target.data(), target.data()));
+
+        for (int i = 0; i<32; i++) {
+            std::vector<uint8_t> below_1 = target;
+            below_1[31-i]--;
+            EXPECT_TRUE(PoWHelper::passesTarget(below_1.data(), target.data()));
+            EXPECT_EQ(PoWHelper::passesTarget(below_1, target),
+                      PoWHelper::passesTarget(below_1.data(), target.data()));
+
+            std::vector<uint8_t> over_1 = target;
+            over_1[31-i]++;
+            EXPECT_FALSE(PoWHelper::passesTarget(over_1.data(), target.data()));
+            EXPECT_EQ(PoWHelper::passesTarget(over_1, target),
+                      PoWHelper::passesTarget(over_1.data(), target.data()));
+        }
+
+        std::vector<uint8_t> short_target(31, 0xFF);
+        EXPECT_FALSE(PoWHelper::passesTarget(target, short_target));
+    }
+
+    TEST(PoWHelper, VerifyInputRejectsMalformedTargetWithoutHasher) {
+        // take every hasher the budget allows, so acquiring one would block
+        Qryptonight::setHasherBudget(1);
+        std::vector<QryptonightPool::uniqueQryptonightPtr> held;
+        while (auto qn = QryptonightPool::hashers()->tryAcquire()) {
+            held.push_back(std::move(qn));
+        }
+
+        PoWHelper ph;
+        std::vector<uint8_t> input(76, 0x05);
+        auto verified = std::async(std::launch::async, [&]() {
+            return ph.verifyInput(input, std::vector<uint8_t>(31, 0xFF));
+        });
+        const bool returned = verified.wait_for(std::chrono::seconds(2))==std::future_status::ready;
+
+        held.clear();
+        Qryptonight::setHasherBudget(0);
+        EXPECT_TRUE(returned);
+        EXPECT_FALSE(verified.get());
+    }
+
 }
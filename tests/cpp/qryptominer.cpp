@@ -115,6 +115,41 @@ TEST(Qryptominer, Run1Thread)
     EXPECT_EQ(expected_hash, qm.solutionHash());
 }
 
+TEST(Qryptominer, Run1ThreadInterleaved)
+{
+    Qryptominer qm;
+    qm.setInterleave(3);
+    EXPECT_EQ(3, qm.interleave());
+
+    std::vector<uint8_t> input{
+            0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+            0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+            0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+            0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+            0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+            0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+            0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+            0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09
+    };
+
+    std::vector<uint8_t> target = {
+            0x0F, 0xFF, 0xFF, 0xE1, 0xAC, 0xF3, 0x55, 0x92,
+            0x66, 0xD8, 0x43, 0x89, 0xCE, 0xDE, 0x99, 0x33,
+            0xC6, 0x8F, 0xC5, 0x1E, 0xD0, 0xA6, 0xC7, 0x91,
+            0xF8, 0xF9, 0xE8, 0x9D, 0xB6, 0x23, 0xF0, 0x0F
+    };
+
+    qm.start(input, 0, target);
+
+    qm.waitForAnswer(60);
+
+    ASSERT_TRUE(qm.solutionAvailable());
+    EXPECT_EQ(37, qm.solutionNonce());
+
+    Qryptonight qn;
+    EXPECT_EQ(qn.hash(qm.solutionInput()), qm.solutionHash());
+}
+
 TEST(Qryptominer, RunThreads_KeepHashing)
 {
     Qryptominer qm;
@@ -311,4 +346,38 @@ TEST(Qryptominer, RunCancelSafety)
     ASSERT_FALSE(qm.isRunning());
 }
 
+TEST(Qryptominer, HashRateStatistics)
+{
+    Qryptominer qm;
+
+    std::vector<uint8_t> input(76, 0x05);
+    const std::vector<uint8_t> impossible(32, 0x00);
+
+    qm.start(input, 39, impossible, 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    // stopped, so the rates hold still while they are compared
+    qm.cancel();
+
+    EXPECT_GT(qm.hashCount(), 0);
+    EXPECT_GT(qm.hashRate(), 0);
+    EXPECT_GT(qm.hashRateEwma(), 0);
+    EXPECT_GT(qm.hashRateWindow(), 0);
+
+    // the aggregate is the sum of the workers, which all did their share
+    auto ewma = qm.threadHashRatesEwma();
+    auto window = qm.threadHashRatesWindow();
+    ASSERT_EQ(2, ewma.size());
+    ASSERT_EQ(2, window.size());
+    EXPECT_GT(ewma[0], 0);
+    EXPECT_GT(ewma[1], 0);
+    EXPECT_DOUBLE_EQ(ewma[0]+ewma[1], qm.hashRateEwma());
+    EXPECT_DOUBLE_EQ(window[0]+window[1], qm.hashRateWindow());
+
+    // a new job starts counting from zero
+    qm.start(input, 39, impossible, 2);
+    EXPECT_EQ(0, qm.hashRateEwma());
+    qm.cancel();
+}
+
 }
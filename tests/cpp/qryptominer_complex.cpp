@@ -21,7 +21,11 @@
   *
   */
 #include <iostream>
+#include <algorithm>
+#include <mutex>
 #include <qryptonight/qryptominer.h>
+#include <qryptonight/numatopology.h>
+#include <qryptonight/qryptonight.h>
 #include <misc/bignum.h>
 #include <pow/powhelper.h>
 #include "gtest/gtest.h"
@@ -73,4 +77,406 @@ namespace {
             qm.cancel();
         }
     }
+
+    class WorkerMiner: public Qryptominer
+    {
+    public:
+        size_t workerCount() { return _runningThreads.size(); }
+    };
+
+    TEST(Qryptominer, RestartKeepsWorkers) {
+        WorkerMiner qm;
+
+        std::vector<uint8_t> input(76, 0x05);
+
+        std::vector<uint8_t> boundary = {
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                0x66, 0xD8, 0x43, 0x89, 0xCE, 0xDE, 0x99, 0x33,
+                0xC6, 0x8F, 0xC5, 0x1E, 0xD0, 0xA6, 0xC7, 0x91,
+                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        };
+
+        uint64_t last_seq = 0;
+        for(int i=0; i<10; i++)
+        {
+            using namespace std::chrono_literals;
+            input[39] = static_cast<uint8_t>(i);
+            const auto seq = qm.start(input, 39, boundary, 2);
+            EXPECT_GT(seq, last_seq);
+            last_seq = seq;
+            std::this_thread::sleep_for(50ms);
+            EXPECT_EQ(2, qm.workerCount());
+        }
+
+        // a smaller job parks the extra worker instead of ending it
+        qm.start(input, 39, boundary, 1);
+        for(int i=0; i<100 && qm.runningThreadCount()!=1; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_EQ(1, qm.runningThreadCount());
+        EXPECT_EQ(2, qm.workerCount());
+
+        qm.cancel();
+        EXPECT_FALSE(qm.isRunning());
+        EXPECT_EQ(2, qm.workerCount());
+        EXPECT_FALSE(qm.solutionAvailable());
+    }
+
+    TEST(Qryptominer, HotSwapSolvesNewJobOnly) {
+        Qryptominer qm;
+        // one nonce per pass, so the first pass of either worker is below 2
+        qm.setInterleave(1);
+
+        std::vector<uint8_t> input(76, 0x05);
+
+        const std::vector<uint8_t> impossible(32, 0x00);
+        const std::vector<uint8_t> trivial(32, 0xFF);
+
+        qm.start(input, 39, impossible, 2);
+        for(int i=0; i<1000 && !qm.isRunning(); i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        // the workers move over without being stopped, and only the new
+        // input can make it into the solution
+        input[0] = 0x77;
+        const auto seq = qm.start(input, 39, trivial, 2);
+        ASSERT_TRUE(qm.waitForAnswer(10));
+        EXPECT_EQ(seq, qm.currentSequenceId());
+        EXPECT_EQ(0x77, qm.solutionInput()[0]);
+        EXPECT_LT(qm.solutionNonce(), 2u);
+
+        qm.cancel();
+        EXPECT_FALSE(qm.isRunning());
+    }
+
+    TEST(Qryptominer, PlacementFitsL3) {
+        WorkerMiner qm;
+        qm.setPlacement(QN_PLACE_CORES);
+        EXPECT_EQ(QN_PLACE_CORES, qm.placement());
+
+        const auto cpus = NumaTopology::instance().minerCpus(false, 2*1024*1024);
+
+        std::vector<uint8_t> input(76, 0x05);
+        const std::vector<uint8_t> impossible(32, 0x00);
+
+        qm.start(input, 39, impossible, 0);
+        if (cpus.empty()) {
+            EXPECT_EQ(std::thread::hardware_concurrency(), qm.workerCount());
+        }
+        else {
+            EXPECT_EQ(cpus.size(), qm.workerCount());
+        }
+
+        for(int i=0; i<1000 && qm.runningThreadCount()!=qm.workerCount(); i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_EQ(qm.workerCount(), qm.runningThreadCount());
+
+        qm.cancel();
+        EXPECT_FALSE(qm.isRunning());
+    }
+
+    class EventMiner: public Qryptominer
+    {
+    public:
+        uint8_t handleEvent(MinerEvent event) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            events.push_back(event);
+            return 1;
+        }
+
+        std::vector<MinerEvent> received()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return events;
+        }
+
+        std::mutex mutex;
+        std::vector<MinerEvent> events;
+    };
+
+    TEST(Qryptominer, NonceRangeExhausts) {
+        EventMiner qm;
+        qm.setNonceRange(100, 111);
+
+        std::vector<uint8_t> input(76, 0x05);
+        const std::vector<uint8_t> impossible(32, 0x00);
+
+        const auto seq = qm.start(input, 39, impossible, 2);
+        for(int i=0; i<600 && qm.received().empty(); i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        // the other worker may still be finishing its last pass
+        for(int i=0; i<600 && qm.isRunning(); i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        auto events = qm.received();
+        ASSERT_EQ(1, events.size());
+        EXPECT_EQ(NONCE_EXHAUSTED, events[0].type);
+        EXPECT_EQ(seq, events[0].seq);
+        EXPECT_EQ(111, qm.nonceCursor());
+        EXPECT_EQ(11, qm.hashCount());
+
+        // resuming from the cursor of an exhausted range has nothing left to do
+        qm.setNonceRange(qm.nonceCursor(), 111);
+        qm.start(input, 39, impossible, 2);
+        for(int i=0; i<100 && qm.received().size()<2; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_EQ(2, qm.received().size());
+        EXPECT_EQ(0, qm.hashCount());
+        qm.cancel();
+    }
+
+    TEST(Qryptominer, ExtraNonceRolls) {
+        Qryptominer qm;
+        qm.setExtraNonce(60, 2);
+        qm.setNonceRange((uint64_t{1} << 32)+5, uint64_t{1} << 40);
+
+        std::vector<uint8_t> input(76, 0x05);
+        input[60] = 0x00;
+        input[61] = 0xFF;
+        const std::vector<uint8_t> trivial(32, 0xFF);
+
+        qm.start(input, 39, trivial, 1);
+        ASSERT_TRUE(qm.waitForAnswer(10));
+        EXPECT_EQ(5, qm.solutionNonce());
+
+        // the nonce space was used up once, so the extra nonce moved on by one
+        auto solution = qm.solutionInput();
+        EXPECT_EQ(0x01, solution[60]);
+        EXPECT_EQ(0x00, solution[61]);
+
+        EXPECT_THROW(qm.setExtraNonce(60, 5), std::invalid_argument);
+        qm.setExtraNonce(40, 2);
+        EXPECT_THROW(qm.start(input, 39, trivial, 1), std::invalid_argument);
+    }
+
+    TEST(Qryptominer, ShareModeKeepsMining) {
+        EventMiner qm;
+        const std::vector<uint8_t> trivial(32, 0xFF);
+        const std::vector<uint8_t> impossible(32, 0x00);
+
+        EXPECT_THROW(qm.setShareTarget(std::vector<uint8_t>(31, 0xFF)), std::invalid_argument);
+        qm.setShareTarget(trivial);
+        EXPECT_EQ(trivial, qm.shareTarget());
+
+        std::vector<uint8_t> input(76, 0x05);
+        qm.start(input, 39, impossible, 2);
+        for(int i=0; i<600 && qm.received().size()<5; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        EXPECT_TRUE(qm.isRunning());
+        EXPECT_FALSE(qm.solutionAvailable());
+        qm.cancel();
+
+        auto events = qm.received();
+        ASSERT_GE(events.size(), 5);
+
+        Qryptonight qn;
+        std::vector<uint32_t> nonces;
+        for (const auto &event : events) {
+            EXPECT_EQ(SHARE, event.type);
+            nonces.push_back(event.nonce);
+
+            auto share_input = input;
+            share_input[39] = static_cast<uint8_t>(event.nonce >> 24);
+            share_input[40] = static_cast<uint8_t>(event.nonce >> 16);
+            share_input[41] = static_cast<uint8_t>(event.nonce >> 8);
+            share_input[42] = static_cast<uint8_t>(event.nonce);
+            EXPECT_EQ(qn.hash(share_input), event.hash);
+        }
+
+        // every nonce is hashed once, so no share is reported twice
+        std::sort(nonces.begin(), nonces.end());
+        EXPECT_EQ(nonces.end(), std::unique(nonces.begin(), nonces.end()));
+    }
+
+    TEST(Qryptominer, ShareModeBlockSolution) {
+        EventMiner qm;
+        const std::vector<uint8_t> trivial(32, 0xFF);
+        qm.setShareTarget(trivial);
+
+        std::vector<uint8_t> input(76, 0x05);
+        const auto seq = qm.start(input, 39, trivial, 1);
+        ASSERT_TRUE(qm.waitForAnswer(10));
+        for(int i=0; i<100 && qm.isRunning(); i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_FALSE(qm.isRunning());
+
+        // the block solution also counts as a share
+        for(int i=0; i<100 && qm.received().size()<2; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        auto events = qm.received();
+        ASSERT_EQ(2, events.size());
+        EXPECT_EQ(SHARE, events[0].type);
+        EXPECT_EQ(SOLUTION, events[1].type);
+        EXPECT_EQ(seq, events[1].seq);
+        EXPECT_EQ(events[0].nonce, events[1].nonce);
+        EXPECT_EQ(qm.solutionHash(), events[1].hash);
+
+        // events carry what was hashed, no need to ask the miner again
+        EXPECT_EQ(qm.solutionInput(), events[1].input);
+        EXPECT_EQ(events[1].input, events[0].input);
+        EXPECT_EQ(0, qm.droppedEvents());
+    }
+
+    TEST(Qryptominer, WaitForAnswerMilliseconds) {
+        Qryptominer qm;
+
+        std::vector<uint8_t> input(76, 0x05);
+        const std::vector<uint8_t> impossible(32, 0x00);
+        const std::vector<uint8_t> trivial(32, 0xFF);
+
+        // one lane, so a pass is a single hash
+        qm.setInterleave(1);
+
+        // how long one hash takes here, sanitizer builds are much slower
+        Qryptonight qn;
+        qn.hash(input);
+        auto begin = std::chrono::steady_clock::now();
+        qn.hash(input);
+        const auto one_hash = std::chrono::steady_clock::now()-begin;
+
+        qm.start(input, 39, impossible, 1);
+        begin = std::chrono::steady_clock::now();
+        EXPECT_FALSE(qm.waitForAnswerMilliseconds(50));
+        EXPECT_GE(std::chrono::steady_clock::now()-begin, std::chrono::milliseconds(50));
+
+        // woken by the solution, not by a later poll. The worker finishes the
+        // pass of the old job, then solves with the first hash of the new one
+        begin = std::chrono::steady_clock::now();
+        qm.start(input, 39, trivial, 1);
+        EXPECT_TRUE(qm.waitForAnswerMilliseconds(10000));
+        EXPECT_LT(std::chrono::steady_clock::now()-begin, 4*one_hash+std::chrono::milliseconds(500));
+        EXPECT_TRUE(qm.waitForAnswerMilliseconds(0));
+    }
+
+    TEST(Qryptominer, StartAsyncOutcome) {
+        Qryptominer qm;
+
+        std::vector<uint8_t> input(76, 0x05);
+        const std::vector<uint8_t> impossible(32, 0x00);
+        const std::vector<uint8_t> trivial(32, 0xFF);
+
+        auto solved = qm.startAsync(input, 39, trivial, 2);
+        ASSERT_EQ(std::future_status::ready, solved.wait_for(std::chrono::seconds(10)));
+        EXPECT_EQ(SOLUTION, solved.get().type);
+        EXPECT_EQ(qm.currentSequenceId(), solved.get().seq);
+        EXPECT_EQ(qm.solutionInput(), solved.get().input);
+        EXPECT_EQ(qm.solutionHash(), solved.get().hash);
+
+        // replaced and cancelled jobs have no outcome
+        auto replaced = qm.startAsync(input, 39, impossible, 2);
+        auto cancelled = qm.startAsync(input, 39, impossible, 2);
+        EXPECT_THROW(replaced.get(), std::future_error);
+        qm.cancel();
+        EXPECT_THROW(cancelled.get(), std::future_error);
+
+        qm.setNonceRange(0, 3);
+        auto exhausted = qm.startAsync(input, 39, impossible, 2);
+        ASSERT_EQ(std::future_status::ready, exhausted.wait_for(std::chrono::seconds(10)));
+        EXPECT_EQ(NONCE_EXHAUSTED, exhausted.get().type);
+        EXPECT_EQ(qm.currentSequenceId(), exhausted.get().seq);
+    }
+
+    TEST(Qryptominer, TimerEndsItsJobOnly) {
+        EventMiner qm;
+
+        std::vector<uint8_t> input(76, 0x05);
+        const std::vector<uint8_t> impossible(32, 0x00);
+
+        // set before start(), the deadline belongs to the next job
+        qm.setTimer(50);
+        const auto begin = std::chrono::steady_clock::now();
+        auto timed_out = qm.startAsync(input, 39, impossible, 2);
+        ASSERT_EQ(std::future_status::ready, timed_out.wait_for(std::chrono::seconds(10)));
+        EXPECT_GE(std::chrono::steady_clock::now()-begin, std::chrono::milliseconds(50));
+        EXPECT_LT(std::chrono::steady_clock::now()-begin, std::chrono::milliseconds(500));
+        EXPECT_EQ(TIMEOUT, timed_out.get().type);
+        EXPECT_EQ(qm.currentSequenceId(), timed_out.get().seq);
+        EXPECT_EQ(0, qm.getSecondsRemaining());
+
+        for(int i=0; i<100 && qm.received().empty(); i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        auto events = qm.received();
+        ASSERT_EQ(1, events.size());
+        EXPECT_EQ(TIMEOUT, events[0].type);
+        EXPECT_EQ(timed_out.get().seq, events[0].seq);
+
+        // a deadline set for a job does not carry over to the one replacing it
+        qm.start(input, 39, impossible, 2);
+        qm.setTimer(50);
+        EXPECT_GT(qm.getSecondsRemaining(), 0);
+        qm.start(input, 39, impossible, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        EXPECT_TRUE(qm.isRunning());
+        EXPECT_EQ(1, qm.received().size());
+        qm.cancel();
+
+        // set while idle, it still goes to the next job when a cancel() in
+        // between moves the sequence id on
+        qm.setTimer(50);
+        qm.cancel();
+        auto next = qm.startAsync(input, 39, impossible, 2);
+        ASSERT_EQ(std::future_status::ready, next.wait_for(std::chrono::seconds(10)));
+        EXPECT_EQ(TIMEOUT, next.get().type);
+        EXPECT_EQ(qm.currentSequenceId(), next.get().seq);
+    }
+
+    class ReluctantMiner: public Qryptominer
+    {
+    public:
+        uint8_t handleEvent(MinerEvent event) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            attempts.push_back(std::chrono::steady_clock::now());
+            return attempts.size()>3 ? 1 : 0;
+        }
+
+        std::mutex mutex;
+        std::vector<std::chrono::steady_clock::time_point> attempts;
+    };
+
+    TEST(Qryptominer, UnhandledEventBacksOff) {
+        ReluctantMiner qm;
+
+        std::vector<uint8_t> input(76, 0x05);
+        const std::vector<uint8_t> trivial(32, 0xFF);
+        qm.start(input, 39, trivial, 1);
+
+        for(int i=0; i<1000; i++)
+        {
+            {
+                std::lock_guard<std::mutex> lock(qm.mutex);
+                if (qm.attempts.size()>=4) {
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        // three refusals are retried after 1, 2 and 4 ms instead of 100 ms each
+        std::lock_guard<std::mutex> lock(qm.mutex);
+        ASSERT_EQ(4, qm.attempts.size());
+        EXPECT_LT(qm.attempts[3]-qm.attempts[0], std::chrono::milliseconds(150));
+        EXPECT_GE(qm.attempts[3]-qm.attempts[0], std::chrono::milliseconds(7));
+    }
 }
@@ -21,14 +21,26 @@
   *
   */
 #include <iostream>
+#include <algorithm>
 #include <qryptonight/qryptonight.h>
 #include <misc/bignum.h>
 #include "gtest/gtest.h"
 
+#if defined(__linux__) || defined(__APPLE__)
+#include "hash-ops.h"
+#endif
+
 namespace {
 TEST(QryptoNight, Init) {
   Qryptonight qn;
   EXPECT_TRUE(qn.isValid());
+  EXPECT_EQ("", qn.lastError());
+}
+
+TEST(QryptoNight, PageType) {
+  Qryptonight qn;
+  EXPECT_TRUE(qn.isValid());
+  EXPECT_FALSE(qn.pageType().empty());
 }
 
 TEST(QryptoNight, RunSingleHash) {
@@ -78,4 +90,132 @@ TEST(QryptoNight, RunSingleHashBigBlob) {
   EXPECT_EQ(output_expected, output);
 }
 
+TEST(QryptoNight, RunSingleHashRawBuffers) {
+  Qryptonight qn;
+  EXPECT_TRUE(qn.isValid());
+
+  std::vector<uint8_t> input{
+      0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+      0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+      0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+      0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+      0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+      0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+      0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09,
+      0x03, 0x05, 0x07, 0x09, 0x03, 0x05, 0x07, 0x09
+  };
+
+  std::array<uint8_t, 32> output_expected{
+      0xd7, 0xf6, 0x86, 0xcc, 0xdf, 0xb4, 0xe8, 0x59,
+      0xe1, 0x62, 0xf9, 0x6d, 0xdd, 0x6a, 0x3b, 0x75,
+      0x79, 0xf2, 0x00, 0xf2, 0xf0, 0xe4, 0x26, 0xae,
+      0x14, 0x32, 0x74, 0xbe, 0x06, 0x1a, 0x8c, 0xf0
+  };
+
+  std::array<uint8_t, 32> output{};
+  qn.hash(input.data(), input.size(), output);
+  EXPECT_EQ(output_expected, output);
+
+  uint8_t raw_output[32] = {};
+  qn.hash(input.data(), input.size(), raw_output);
+  EXPECT_TRUE(std::equal(output.begin(), output.end(), raw_output));
+}
+
+TEST(QryptoNight, RunSingleHashShortInput) {
+  Qryptonight qn;
+  EXPECT_TRUE(qn.isValid());
+
+  std::vector<uint8_t> input(42);
+  std::array<uint8_t, 32> output{};
+
+  EXPECT_THROW(qn.hash(input.data(), input.size(), output), std::invalid_argument);
+  EXPECT_THROW(qn.hash(input), std::invalid_argument);
+}
+
+TEST(QryptoNight, RunMultiHash) {
+  Qryptonight qn;
+  EXPECT_TRUE(qn.isValid());
+
+  const size_t input_size = 76;
+  std::vector<uint8_t> inputs(input_size*QRYPTONIGHT_MAX_WAYS);
+  for (size_t i = 0; i < inputs.size(); i++) {
+    inputs[i] = static_cast<uint8_t>(i * 13);
+  }
+
+  std::vector<std::vector<uint8_t>> outputs_expected;
+  for (size_t n = 0; n < QRYPTONIGHT_MAX_WAYS; n++) {
+    std::vector<uint8_t> input(inputs.begin() + n * input_size, inputs.begin() + (n + 1) * input_size);
+    outputs_expected.push_back(qn.hash(input));
+  }
+
+  for (size_t count = 1; count <= QRYPTONIGHT_MAX_WAYS; count++) {
+    std::vector<uint8_t> outputs(32 * count);
+    qn.hashN(inputs.data(), input_size, outputs.data(), count);
+
+    for (size_t n = 0; n < count; n++) {
+      std::vector<uint8_t> output(outputs.begin() + n * 32, outputs.begin() + (n + 1) * 32);
+      EXPECT_EQ(outputs_expected[n], output) << "count " << count << " lane " << n;
+    }
+  }
+
+  uint8_t output[32];
+  EXPECT_THROW(qn.hashN(inputs.data(), input_size, output, 0), std::invalid_argument);
+  EXPECT_THROW(qn.hashN(inputs.data(), input_size, output, QRYPTONIGHT_MAX_WAYS + 1), std::invalid_argument);
+}
+
+TEST(QryptoNight, RunMultiHashVector) {
+  Qryptonight qn;
+  EXPECT_TRUE(qn.isValid());
+
+  std::vector<std::vector<uint8_t>> inputs;
+  for (uint8_t n = 0; n < 7; n++) {
+    inputs.emplace_back(64, n);
+  }
+
+  auto outputs = qn.hashN(inputs);
+  ASSERT_EQ(inputs.size(), outputs.size());
+  for (size_t n = 0; n < inputs.size(); n++) {
+    EXPECT_EQ(qn.hash(inputs[n]), outputs[n]);
+  }
+
+  inputs.emplace_back(65, 0);
+  EXPECT_THROW(qn.hashN(inputs), std::invalid_argument);
+}
+
+#if defined(__linux__) || defined(__APPLE__)
+TEST(QryptoNight, MatchesReferenceImplementation) {
+  Qryptonight qn;
+  EXPECT_TRUE(qn.isValid());
+
+  for (size_t input_size : {43, 76, 137, 1000}) {
+    std::vector<uint8_t> input(input_size);
+    for (size_t i = 0; i < input_size; i++) {
+      input[i] = static_cast<uint8_t>(i * 7 + input_size);
+    }
+
+    std::vector<uint8_t> output_expected(32);
+    cn_slow_hash(input.data(), input.size(), reinterpret_cast<char *>(output_expected.data()), 1, 0, 0);
+
+    EXPECT_EQ(output_expected, qn.hash(input));
+  }
+}
+
+TEST(QryptoNight, InstancesKeepSeparateState) {
+  Qryptonight qn1;
+  Qryptonight qn2;
+  EXPECT_TRUE(qn1.isValid());
+  EXPECT_TRUE(qn2.isValid());
+
+  std::vector<uint8_t> input1(76, 0x11);
+  std::vector<uint8_t> input2(76, 0x22);
+
+  auto output1 = qn1.hash(input1);
+  auto output2 = qn2.hash(input2);
+
+  EXPECT_NE(output1, output2);
+  EXPECT_EQ(output1, qn2.hash(input1));
+  EXPECT_EQ(output2, qn1.hash(input2));
+}
+#endif
+
 }
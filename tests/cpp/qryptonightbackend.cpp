@@ -0,0 +1,165 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+#include <algorithm>
+#include <qryptonight/qryptonight.h>
+#include "gtest/gtest.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <qryptonight/cnbackend.h>
+#include "cncontexts.h"
+#include "hash-ops.h"
+#endif
+
+namespace {
+TEST(QryptoNightBackend, ActiveIsAvailable) {
+  auto available = Qryptonight::availableBackends();
+  ASSERT_FALSE(available.empty());
+
+  auto active = Qryptonight::activeBackend();
+  EXPECT_NE(std::find(available.begin(), available.end(), active), available.end());
+}
+
+TEST(QryptoNightBackend, RejectsUnknown) {
+  auto active = Qryptonight::activeBackend();
+  EXPECT_FALSE(Qryptonight::selectBackend("no-such-backend"));
+  EXPECT_EQ(active, Qryptonight::activeBackend());
+}
+
+#if defined(__linux__) || defined(__APPLE__)
+TEST(QryptoNightBackend, SoftAlwaysAvailable) {
+  auto available = Qryptonight::availableBackends();
+  EXPECT_NE(std::find(available.begin(), available.end(), "soft"), available.end());
+}
+
+TEST(QryptoNightBackend, ReferenceAheadOfSoft) {
+  // outside x86-64 the reference is the hardware AES path, it must not lose to soft
+  auto available = Qryptonight::availableBackends();
+  auto reference = std::find(available.begin(), available.end(), "reference");
+  ASSERT_NE(reference, available.end());
+  EXPECT_LT(reference, std::find(available.begin(), available.end(), "soft"));
+}
+
+TEST(QryptoNightBackend, AllMatchReferenceImplementation) {
+  const auto original = Qryptonight::activeBackend();
+
+  std::vector<uint8_t> input(76);
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = static_cast<uint8_t>(i * 13 + 1);
+  }
+
+  std::vector<uint8_t> output_expected(32);
+  cn_slow_hash(input.data(), input.size(), reinterpret_cast<char *>(output_expected.data()), 1, 0, 0);
+
+  Qryptonight qn;
+  ASSERT_TRUE(qn.isValid());
+
+  for (const auto &backend : Qryptonight::availableBackends()) {
+    ASSERT_TRUE(Qryptonight::selectBackend(backend));
+    EXPECT_EQ(backend, Qryptonight::activeBackend());
+    EXPECT_EQ(output_expected, qn.hash(input)) << backend;
+
+    auto outputs = qn.hashN({input, input, input});
+    for (const auto &output : outputs) {
+      EXPECT_EQ(output_expected, output) << backend;
+    }
+  }
+
+  EXPECT_TRUE(Qryptonight::selectBackend(original));
+}
+
+TEST(QryptoNightBackend, InterleavedMatchReferenceImplementation) {
+  const auto original = Qryptonight::activeBackend();
+
+  std::vector<std::vector<uint8_t>> inputs;
+  std::vector<std::vector<uint8_t>> outputs_expected;
+  for (size_t n = 0; n < QRYPTONIGHT_MAX_WAYS; n++) {
+    std::vector<uint8_t> input(76);
+    for (size_t i = 0; i < input.size(); i++) {
+      input[i] = static_cast<uint8_t>(i * 29 + n * 3);
+    }
+
+    std::vector<uint8_t> output_expected(32);
+    cn_slow_hash(input.data(), input.size(), reinterpret_cast<char *>(output_expected.data()), 1, 0, 0);
+
+    inputs.push_back(input);
+    outputs_expected.push_back(output_expected);
+  }
+
+  Qryptonight qn;
+  ASSERT_TRUE(qn.isValid());
+
+  for (const auto &backend : Qryptonight::availableBackends()) {
+    ASSERT_TRUE(Qryptonight::selectBackend(backend));
+    EXPECT_EQ(outputs_expected, qn.hashN(inputs)) << backend;
+  }
+
+  EXPECT_TRUE(Qryptonight::selectBackend(original));
+}
+
+TEST(QryptoNightBackend, TestSizedAlgoAgreesAcrossBackends) {
+  CnContexts ctx;
+  auto &registry = CnBackendRegistry::instance();
+
+  const size_t input_len = 76;
+  std::vector<uint8_t> input(input_len * CN_MAX_WAYS);
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = static_cast<uint8_t>(i * 31 + 5);
+  }
+
+  // single lane soft AES is the baseline
+  std::vector<uint8_t> output_expected(32 * CN_MAX_WAYS);
+  for (size_t n = 0; n < CN_MAX_WAYS; n++) {
+    registry.find("soft")->kernels[CN_ALGO_TEST](input.data() + n * input_len, input_len,
+                                                 output_expected.data() + n * 32, ctx.contexts, 1);
+  }
+
+  for (const auto &name : registry.available()) {
+    for (size_t ways = 1; ways <= CN_MAX_WAYS; ways++) {
+      std::vector<uint8_t> output(32 * ways);
+      registry.find(name)->kernels[CN_ALGO_TEST](input.data(), input_len, output.data(), ctx.contexts, ways);
+      EXPECT_TRUE(std::equal(output.begin(), output.end(), output_expected.begin())) << name << " ways " << ways;
+    }
+  }
+}
+
+TEST(QryptoNightBackend, Variant0MatchesReferenceImplementation) {
+  CnContexts ctx;
+  auto &registry = CnBackendRegistry::instance();
+
+  std::vector<uint8_t> input(76);
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = static_cast<uint8_t>(i * 3 + 11);
+  }
+
+  std::vector<uint8_t> output_expected(32);
+  cn_slow_hash(input.data(), input.size(), reinterpret_cast<char *>(output_expected.data()), 0, 0, 0);
+
+  for (const auto &name : registry.available()) {
+    std::vector<uint8_t> output(32);
+    registry.find(name)->kernels[CN_ALGO_V0](input.data(), input.size(), output.data(), ctx.contexts, 1);
+    EXPECT_EQ(output_expected, output) << name;
+  }
+}
+#endif
+
+}
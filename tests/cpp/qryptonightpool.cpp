@@ -21,6 +21,12 @@
   *
   */
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
 #include <qryptonight/qryptonightpool.h>
 #include "gtest/gtest.h"
 
@@ -156,4 +162,419 @@ namespace {
         EXPECT_EQ(QryptonightWithRefCount::_instances, 0);
     }
 
+    TEST(QryptoNightPool, SameThreadReusesInstance) {
+        auto pool = std::make_shared<QryptonightPool>(factory);
+
+        Qryptonight *first;
+        {
+            auto qn = pool->acquire();
+            first = qn.get();
+        }
+        EXPECT_EQ(pool->size(), 1);
+
+        for (int i = 0; i < 100; i++) {
+            auto qn = pool->acquire();
+            EXPECT_EQ(first, qn.get());
+            EXPECT_EQ(pool->size(), 0);
+        }
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 1);
+
+        pool.reset();
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 0);
+    }
+
+    TEST(QryptoNightPool, ConcurrentAcquireRelease) {
+        auto pool = std::make_shared<QryptonightPool>();
+        const size_t threadCount = 8;
+
+        std::vector<std::thread> threads;
+        std::vector<size_t> failures(threadCount, 0);
+        for (size_t t = 0; t < threadCount; t++) {
+            threads.emplace_back([&pool, &failures, t]() {
+                std::vector<QryptonightPool::uniqueQryptonightPtr> held;
+                for (int i = 0; i < 200; i++) {
+                    held.push_back(pool->acquire());
+                    if (!held.back()->isValid()) {
+                        failures[t]++;
+                    }
+                    // release out of order, sometimes keeping two at once
+                    if (held.size() > 1 || i % 3 == 0) {
+                        held.erase(held.begin());
+                    }
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        for (auto failure : failures) {
+            EXPECT_EQ(0, failure);
+        }
+        // the exited threads handed their cached instances back
+        EXPECT_GE(pool->size(), 1);
+        EXPECT_LE(pool->size(), 2 * threadCount);
+    }
+
+    TEST(QryptoNightPool, ReleaseOnAnotherThread) {
+        auto pool = std::make_shared<QryptonightPool>(factory);
+
+        auto qn = pool->acquire();
+        std::thread([&qn]() { qn.reset(); }).join();
+        EXPECT_EQ(pool->size(), 1);
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 1);
+
+        pool.reset();
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 0);
+    }
+
+    TEST(QryptoNightPool, DeletePoolWhileCachedOnAnotherThread) {
+        auto pool = std::make_shared<QryptonightPool>(factory);
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool released = false;
+        bool poolDeleted = false;
+
+        std::thread worker([&]() {
+            pool->acquire().reset();
+            std::unique_lock<std::mutex> lock(mutex);
+            released = true;
+            cv.notify_all();
+            cv.wait(lock, [&]() { return poolDeleted; });
+        });
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return released; });
+            EXPECT_EQ(pool->size(), 1);
+            pool.reset();
+            EXPECT_EQ(QryptonightWithRefCount::_instances, 0);
+            poolDeleted = true;
+            cv.notify_all();
+        }
+        worker.join();
+    }
+
+    TEST(QryptoNightPool, Reserve) {
+        auto pool = std::make_shared<QryptonightPool>(factory);
+
+        pool->reserve(3);
+        EXPECT_EQ(pool->size(), 3);
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 3);
+
+        auto qn = pool->acquire();
+        EXPECT_EQ(pool->size(), 2);
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 3);
+
+        // already satisfied
+        pool->reserve(2);
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 3);
+
+        pool.reset();
+        qn.reset();
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 0);
+    }
+
+    TEST(QryptoNightPool, ReserveStopsAtMaxIdle) {
+        QryptonightPoolPolicy policy;
+        policy.maxIdle = 2;
+        auto pool = std::make_shared<QryptonightPool>(factory, policy);
+
+        pool->reserve(5);
+        EXPECT_EQ(pool->size(), 2);
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 2);
+    }
+
+    TEST(QryptoNightPool, MaxIdle) {
+        QryptonightPoolPolicy policy;
+        policy.maxIdle = 1;
+        auto pool = std::make_shared<QryptonightPool>(factory, policy);
+
+        auto qn1 = pool->acquire();
+        auto qn2 = pool->acquire();
+        auto qn3 = pool->acquire();
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 3);
+
+        // one goes to the thread cache, one to the freelist, the last is deleted
+        qn1.reset();
+        qn2.reset();
+        qn3.reset();
+        EXPECT_EQ(pool->size(), 2);
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 2);
+
+        policy.maxIdle = 0;
+        pool->setPolicy(policy);
+        EXPECT_EQ(pool->policy().maxIdle, 0);
+        auto qn = pool->acquire();
+        qn.reset();
+        EXPECT_EQ(pool->size(), 1);
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 1);
+    }
+
+    TEST(QryptoNightPool, TrimDeletes) {
+        auto pool = std::make_shared<QryptonightPool>(factory);
+
+        auto qn1 = pool->acquire();
+        auto qn2 = pool->acquire();
+        qn1.reset();
+        qn2.reset();
+        EXPECT_EQ(pool->size(), 2);
+
+        EXPECT_EQ(pool->trim(std::chrono::hours(1)), 0);
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 2);
+
+        EXPECT_EQ(pool->trim(), 2);
+        EXPECT_EQ(pool->size(), 0);
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 0);
+    }
+
+    TEST(QryptoNightPool, TrimKeepsFreshInstances) {
+        auto pool = std::make_shared<QryptonightPool>(factory);
+
+        // one in the thread cache, two in the freelist
+        {
+            auto qn1 = pool->acquire();
+            auto qn2 = pool->acquire();
+            auto qn3 = pool->acquire();
+        }
+
+        // trimming nothing must neither hide instances from acquire() nor lose any
+        std::atomic_bool stop{false};
+        std::thread trimmer([&]() {
+            while (!stop) {
+                pool->trim(std::chrono::hours(1));
+            }
+        });
+        for (int i = 0; i < 2000; i++) {
+            auto qn1 = pool->acquire();
+            auto qn2 = pool->acquire();
+        }
+        stop = true;
+        trimmer.join();
+
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 3);
+        EXPECT_EQ(pool->size(), 3);
+    }
+
+    TEST(QryptoNightPool, TrimDiscardsScratchpads) {
+        QryptonightPoolPolicy policy;
+        policy.trimMode = QN_TRIM_DONTNEED;
+        auto pool = std::make_shared<QryptonightPool>(factory, policy);
+
+        std::vector<uint8_t> input(76, 0x21);
+        auto qn = pool->acquire();
+        auto output_expected = qn->hash(input);
+        qn.reset();
+
+        EXPECT_EQ(pool->trim(), 1);
+        EXPECT_EQ(pool->size(), 1);
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 1);
+
+        // nothing left to give back until it is used again
+        EXPECT_EQ(pool->trim(), 0);
+
+        qn = pool->acquire();
+        EXPECT_EQ(output_expected, qn->hash(input));
+        qn.reset();
+        EXPECT_EQ(pool->trim(), 1);
+    }
+
+    TEST(QryptoNightPool, IdleTimeout) {
+        QryptonightPoolPolicy policy;
+        policy.idleTimeout = std::chrono::milliseconds(20);
+        auto pool = std::make_shared<QryptonightPool>(factory, policy);
+
+        pool->acquire().reset();
+        for (int i = 0; i < 100 && !pool->empty(); i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_TRUE(pool->empty());
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 0);
+    }
+
+    TEST(QryptoNightPool, BudgetTryAndTimedAcquire) {
+        QryptonightPoolPolicy policy;
+        policy.maxLive = 2;
+        auto pool = std::make_shared<QryptonightPool>(factory, policy);
+
+        auto qn1 = pool->acquire();
+        auto qn2 = pool->tryAcquire();
+        ASSERT_TRUE(qn2 != nullptr);
+        EXPECT_EQ(pool->live(), 2);
+
+        EXPECT_TRUE(pool->tryAcquire() == nullptr);
+        EXPECT_TRUE(pool->acquireFor(std::chrono::milliseconds(20)) == nullptr);
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 2);
+
+        qn1.reset();
+        auto qn3 = pool->tryAcquire();
+        EXPECT_TRUE(qn3 != nullptr);
+        EXPECT_EQ(pool->live(), 2);
+    }
+
+    TEST(QryptoNightPool, BudgetBlocksUntilRelease) {
+        QryptonightPoolPolicy policy;
+        policy.maxLive = 1;
+        auto pool = std::make_shared<QryptonightPool>(factory, policy);
+
+        auto qn = pool->acquire();
+        Qryptonight *raw = qn.get();
+
+        std::thread releaser([&qn]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            qn.reset();
+        });
+        auto waited = pool->acquire();
+        releaser.join();
+
+        EXPECT_EQ(raw, waited.get());
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 1);
+    }
+
+    TEST(QryptoNightPool, BudgetTakesFromOtherThreadCache) {
+        QryptonightPoolPolicy policy;
+        policy.maxLive = 1;
+        auto pool = std::make_shared<QryptonightPool>(factory, policy);
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool released = false;
+        bool done = false;
+
+        // the worker keeps its released instance in its thread cache
+        std::thread worker([&]() {
+            pool->acquire().reset();
+            std::unique_lock<std::mutex> lock(mutex);
+            released = true;
+            cv.notify_all();
+            cv.wait(lock, [&]() { return done; });
+        });
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return released; });
+        }
+        auto qn = pool->tryAcquire();
+        EXPECT_TRUE(qn != nullptr);
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 1);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done = true;
+            cv.notify_all();
+        }
+        worker.join();
+    }
+
+    TEST(QryptoNightPool, RaisingBudgetWakesWaiters) {
+        QryptonightPoolPolicy policy;
+        policy.maxLive = 1;
+        auto pool = std::make_shared<QryptonightPool>(factory, policy);
+
+        auto qn = pool->acquire();
+        std::thread raiser([&pool, policy]() mutable {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            policy.maxLive = 2;
+            pool->setPolicy(policy);
+        });
+        auto second = pool->acquireFor(std::chrono::seconds(10));
+        raiser.join();
+
+        EXPECT_TRUE(second != nullptr);
+        EXPECT_EQ(pool->live(), 2);
+    }
+
+    TEST(QryptoNightPool, TrimWakesWaiters) {
+        QryptonightPoolPolicy policy;
+        policy.maxLive = 1;
+        auto pool = std::make_shared<QryptonightPool>(factory, policy);
+        pool->acquire().reset();
+
+        // trim() holds the only instance for a moment now and then, a waiter
+        // must be woken when it goes back rather than sleep until its timeout
+        std::atomic_bool stop{false};
+        std::thread trimmer([&]() {
+            while (!stop) {
+                pool->trim(std::chrono::hours(1));
+            }
+        });
+        const auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < 2000; i++) {
+            auto qn = pool->acquireFor(std::chrono::seconds(10));
+            ASSERT_TRUE(qn != nullptr);
+        }
+        stop = true;
+        trimmer.join();
+
+        EXPECT_LT(std::chrono::steady_clock::now() - begin, std::chrono::seconds(5));
+        EXPECT_EQ(QryptonightWithRefCount::_instances, 1);
+    }
+
+    TEST(QryptoNightPool, HasherBudget) {
+        EXPECT_EQ(Qryptonight::hasherBudget(), 0);
+
+        Qryptonight::setHasherBudget(3);
+        EXPECT_EQ(Qryptonight::hasherBudget(), 3);
+        EXPECT_EQ(QryptonightPool::hashers()->policy().maxLive, 3);
+
+        Qryptonight::setHasherBudget(0);
+        EXPECT_EQ(Qryptonight::hasherBudget(), 0);
+    }
+
+    TEST(QryptoNightPool, Stats) {
+        QryptonightPoolPolicy policy;
+        policy.maxLive = 2;
+        auto pool = std::make_shared<QryptonightPool>(factory, policy);
+
+        pool->reserve(1);
+        auto qn1 = pool->acquire();     // the reserved one
+        auto qn2 = pool->acquire();     // created
+        qn1.reset();
+        qn1 = pool->acquire();          // from the thread cache
+
+        std::thread releaser([&qn2]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            qn2.reset();
+        });
+        auto qn3 = pool->acquire();     // waits for qn2
+        releaser.join();
+
+        auto stats = pool->stats();
+        EXPECT_EQ(stats.hits, 3);
+        EXPECT_EQ(stats.misses, 1);
+        EXPECT_EQ(stats.created, 2);
+        EXPECT_EQ(stats.live, 2);
+        EXPECT_EQ(stats.idle, 0);
+        EXPECT_EQ(stats.waits, 1);
+        EXPECT_GE(stats.waitMicroseconds, 10000);
+
+        // the scratchpads of both instances are accounted for
+        EXPECT_GE(stats.bytes4k + stats.bytesThp + stats.bytes2m + stats.bytes1g, 2 * 2 * 1024 * 1024);
+
+        qn1.reset();
+        qn3.reset();
+        stats = pool->stats();
+        EXPECT_EQ(stats.idle, 2);
+        EXPECT_EQ(stats.live, 2);
+    }
+
+    TEST(QryptoNightPool, ScratchpadBytes) {
+        const uint64_t before = Qryptonight::scratchpadBytes("4k") + Qryptonight::scratchpadBytes("thp") +
+                                Qryptonight::scratchpadBytes("2m") + Qryptonight::scratchpadBytes("1g");
+        {
+            Qryptonight qn;
+            ASSERT_TRUE(qn.isValid());
+            EXPECT_GT(Qryptonight::scratchpadBytes(qn.pageType()), 0);
+
+            const uint64_t during = Qryptonight::scratchpadBytes("4k") + Qryptonight::scratchpadBytes("thp") +
+                                    Qryptonight::scratchpadBytes("2m") + Qryptonight::scratchpadBytes("1g");
+            EXPECT_EQ(before + 2 * 1024 * 1024, during);
+        }
+        const uint64_t after = Qryptonight::scratchpadBytes("4k") + Qryptonight::scratchpadBytes("thp") +
+                               Qryptonight::scratchpadBytes("2m") + Qryptonight::scratchpadBytes("1g");
+        EXPECT_EQ(before, after);
+        EXPECT_EQ(Qryptonight::scratchpadBytes("unknown"), 0);
+    }
+
 }
@@ -0,0 +1,134 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <qryptonight/qryptonightpool.h>
+#include "gtest/gtest.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <qryptonight/scratchpadarena.h>
+#include "hash-ops.h"
+
+namespace {
+ScratchpadArenaConfig smallArena(size_t slots) {
+  // 1 GB pages would reserve far more than the test needs
+  ScratchpadArenaConfig config;
+  config.slots = slots;
+  config.allow1G = false;
+  return config;
+}
+
+TEST(ScratchpadArena, Init) {
+  auto arena = std::make_shared<ScratchpadArena>(smallArena(3));
+  ASSERT_TRUE(arena->isValid()) << arena->lastError();
+  EXPECT_EQ(3, arena->slots());
+  EXPECT_EQ(3, arena->freeSlots());
+}
+
+TEST(ScratchpadArena, NoSlots) {
+  ScratchpadArena arena(smallArena(0));
+  EXPECT_FALSE(arena.isValid());
+  EXPECT_FALSE(arena.lastError().empty());
+  EXPECT_EQ(nullptr, arena.acquire());
+}
+
+TEST(ScratchpadArena, AcquireRelease) {
+  ScratchpadArena arena(smallArena(2));
+  ASSERT_TRUE(arena.isValid());
+
+  auto first = arena.acquire();
+  auto second = arena.acquire();
+  ASSERT_NE(nullptr, first);
+  ASSERT_NE(nullptr, second);
+  EXPECT_EQ(nullptr, arena.acquire());
+
+  // slots do not overlap and keep the kernels' alignment
+  EXPECT_GE(static_cast<size_t>(std::abs(first - second)), static_cast<size_t>(CN_MEMORY));
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(first) % 64);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(second) % 64);
+
+  arena.release(first);
+  EXPECT_EQ(1, arena.freeSlots());
+  EXPECT_EQ(first, arena.acquire());
+}
+
+TEST(ScratchpadArena, QryptonightUsesArena) {
+  auto arena = std::make_shared<ScratchpadArena>(smallArena(2));
+  ASSERT_TRUE(arena->isValid());
+
+  std::vector<uint8_t> input(76, 0x42);
+  std::vector<uint8_t> output_expected(32);
+  cn_slow_hash(input.data(), input.size(), reinterpret_cast<char *>(output_expected.data()), 1, 0, 0);
+
+  {
+    Qryptonight qn(arena);
+    ASSERT_TRUE(qn.isValid());
+    EXPECT_EQ(cn_page_type_name(arena->pageType()), qn.pageType());
+    EXPECT_EQ(1, arena->freeSlots());
+    EXPECT_EQ(output_expected, qn.hash(input));
+
+    // the second slot goes to the first extra interleave lane, the next
+    // lane falls back to a regular allocation
+    auto outputs = qn.hashN({input, input, input});
+    EXPECT_EQ(0, arena->freeSlots());
+    for (const auto &output : outputs) {
+      EXPECT_EQ(output_expected, output);
+    }
+  }
+
+  EXPECT_EQ(2, arena->freeSlots());
+}
+
+TEST(ScratchpadArena, ExhaustedArenaFallsBack) {
+  auto arena = std::make_shared<ScratchpadArena>(smallArena(1));
+  ASSERT_TRUE(arena->isValid());
+
+  Qryptonight qn1(arena);
+  Qryptonight qn2(arena);
+  ASSERT_TRUE(qn1.isValid());
+  ASSERT_TRUE(qn2.isValid());
+
+  const std::set<std::string> fallback{"4k", "thp"};
+  EXPECT_EQ(1, fallback.count(qn2.pageType()));
+}
+
+TEST(ScratchpadArena, PoolFactory) {
+  auto arena = std::make_shared<ScratchpadArena>(smallArena(2));
+  ASSERT_TRUE(arena->isValid());
+
+  auto pool = std::make_shared<QryptonightPool>(QryptonightPool::arenaFactory(arena));
+  {
+    auto qn1 = pool->acquire();
+    auto qn2 = pool->acquire();
+    EXPECT_EQ(0, arena->freeSlots());
+    EXPECT_EQ(cn_page_type_name(arena->pageType()), qn1->pageType());
+  }
+
+  // idle instances in the pool keep their slots
+  EXPECT_EQ(0, arena->freeSlots());
+  pool.reset();
+  EXPECT_EQ(2, arena->freeSlots());
+}
+}
+#endif
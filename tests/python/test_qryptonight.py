@@ -38,3 +38,14 @@ class TestQryptonight(TestCase):
             print("0x{:02x}, ".format(i), sep='', end='')
 
         self.assertEqual(output_expected, output)
+
+    def test_hasher_stats(self):
+        qn = Qryptonight()
+
+        stats = Qryptonight.hasherStats()
+        self.assertGreaterEqual(stats.live, stats.idle)
+        self.assertGreaterEqual(stats.created, stats.misses)
+
+        total = stats.bytes4k + stats.bytesThp + stats.bytes2m + stats.bytes1g
+        self.assertGreaterEqual(total, 2 * 1024 * 1024)
+        self.assertGreater(Qryptonight.scratchpadBytes(qn.pageType()), 0)